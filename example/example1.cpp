@@ -4,6 +4,19 @@
 
 int main(int argc, char* argv[])
 {
+    CommandLineMenu submenu;
+    submenu.setTopText("Sub Menu");
+
+    submenu.addOption("Func 1", []() {
+        std::cout << "Hello," << std::endl;
+    });
+
+    submenu.addOption("Func 2", []() {
+        std::cout << "World!" << std::endl;
+    });
+
+    submenu.addOption("Placeholder", nullptr);
+
     CommandLineMenu menu;
 
     menu.setEnableShowIndex(true);
@@ -11,7 +24,8 @@ int main(int argc, char* argv[])
     menu.setOptionTextAlignment(2);
     menu.setMaxColumn(3);
     menu.setTopText("Welcome to the command line menu test program");
-    menu.setBottomText("Use the WASD keys to navigate, and the Enter key to select an option, or the Esc key to exit");
+    menu.setBottomText("Use the WASD or arrow keys to navigate, and the Enter key to select an option, or the Esc key to exit.\n"
+        "Type an index to jump to its option.");
 
     menu.addOption("Function A", []()
     {
@@ -41,8 +55,8 @@ int main(int argc, char* argv[])
     {
         auto& menu = *static_cast<CommandLineMenu*>(data);
 
-        if (menu.optionCount() > 0)
-            menu.removeOption(menu.optionCount() - 1);
+        if (menu.getOptionCount() > 0)
+            menu.removeOption(menu.getOptionCount() - 1);
     }, &menu, false);
 
     menu.addOption("Change column", [](void* data)
@@ -60,34 +74,13 @@ int main(int argc, char* argv[])
             return;
         }
 
-        menu.setMaxColumn(newColumn);
+        // Discard the rest of the line, including the LF character.
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    #ifndef _WIN32
-        // Discard the LF character.
-        CommandLineMenu::getkey();
-    #endif // !_WIN32
+        menu.setMaxColumn(newColumn);
     }, &menu);
 
-    menu.addOption("Sub Menu", [](void* data)
-    {
-        auto& menu = *static_cast<CommandLineMenu*>(data);
-
-        CommandLineMenu submenu;
-        submenu.setTopText("Sub Menu");
-
-        submenu.addOption("Func 1", []() {
-            std::cout << "Hello," << std::endl;
-        });
-
-        submenu.addOption("Func 2", []() {
-            std::cout << "World!" << std::endl;
-        });
-
-        submenu.addOption("Placeholder", nullptr);
-
-        submenu.show();
-        submenu.startReceiveInput();
-    }, &menu);
+    menu.addSubmenuOption("Sub Menu", submenu);
 
     menu.addOption("Exit", [](void* data)
     {
@@ -96,6 +89,25 @@ int main(int argc, char* argv[])
         menu.endReceiveInput();
     }, &menu, false);
 
+    // Execute the option paths given as arguments (e.g. "Sub Menu/Func 2"), or read from stdin for "-".
+    if (argc > 1)
+    {
+        bool isStdin = argc == 2 && std::string(argv[1]) == "-";
+        auto results = isStdin ? menu.executePaths(std::cin) : menu.executePaths(argc, argv);
+
+        int exitCode = 0;
+        for (const auto& result : results)
+        {
+            if (result.status != CommandLineMenu::PATH_STATUS_OK)
+            {
+                std::cerr << result.path << ": " << result.message << std::endl;
+                exitCode = 1;
+            }
+        }
+
+        return exitCode;
+    }
+
     menu.show();
     menu.startReceiveInput();
 
@@ -28,18 +28,56 @@
 #ifndef COMMAND_LINE_MENU_HPP
 #define COMMAND_LINE_MENU_HPP
 
+#include <cerrno>       // errno, EINTR
+#include <csignal>      // sig_atomic_t
 #include <cstddef>      // size_t
-#include <cstdlib>      // system()
+#include <cstdint>      // SIZE_MAX, uint64_t
+#include <cstdio>       // EOF
+#include <cstdlib>      // system(), getenv()
+#include <cstring>      // strcmp()
+#include <algorithm>    // equal()
 #include <array>        // array
 #include <atomic>       // atomic
-#include <stdexcept>    // runtime_error
+#include <chrono>       // milliseconds, steady_clock
+#include <exception>    // exception_ptr, current_exception(), rethrow_exception()
+#include <fstream>      // ifstream
+#include <stdexcept>    // runtime_error, out_of_range
 #include <iostream>     // cout, endl
+#include <map>          // map
+#include <memory>       // shared_ptr, make_shared, atomic_load, atomic_compare_exchange_weak
+#include <mutex>        // mutex, lock_guard
 #include <string>       // string
+#include <thread>       // thread, this_thread::sleep_for()
 #include <vector>       // vector
 
 #ifdef _WIN32
     #include <conio.h>  // _getch()
+
+    // Keep the min and max macros and the rarely used APIs of windows.h out of the code including this header.
+    #ifndef NOMINMAX
+        #define NOMINMAX
+        #define COMMAND_LINE_MENU_UNDEF_NOMINMAX
+    #endif // !NOMINMAX
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+        #define COMMAND_LINE_MENU_UNDEF_WIN32_LEAN_AND_MEAN
+    #endif // !WIN32_LEAN_AND_MEAN
+
+    #include <windows.h>
+
+    #ifdef COMMAND_LINE_MENU_UNDEF_NOMINMAX
+        #undef NOMINMAX
+        #undef COMMAND_LINE_MENU_UNDEF_NOMINMAX
+    #endif // COMMAND_LINE_MENU_UNDEF_NOMINMAX
+    #ifdef COMMAND_LINE_MENU_UNDEF_WIN32_LEAN_AND_MEAN
+        #undef WIN32_LEAN_AND_MEAN
+        #undef COMMAND_LINE_MENU_UNDEF_WIN32_LEAN_AND_MEAN
+    #endif // COMMAND_LINE_MENU_UNDEF_WIN32_LEAN_AND_MEAN
 #else
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <sys/ioctl.h>
     #include <termios.h>
     #include <unistd.h>
 #endif // _WIN32
@@ -79,11 +117,74 @@ public:
     };
 #endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
 
-    using VoidFunc      = void (*)();
-    using Arg           = void*;
-    using ArgFunc       = void (*)(Arg);
+    /// @brief The colors supported by a terminal.
+    /// @note Colors are converted to the nearest supported color when output.
+    enum ColorDepth
+    {
+        /// No color, no color attribute is output at all.
+        COLOR_DEPTH_NONE = 0,
+        /// Base 16 colors.
+        COLOR_DEPTH_16,
+        /// ANSI 256 colors.
+        COLOR_DEPTH_256,
+        /// 24-bit RGB colors.
+        COLOR_DEPTH_TRUECOLOR
+    };
+
+    using VoidFunc          = void (*)();
+    using Arg               = void*;
+    using ArgFunc           = void (*)(Arg);
+    using BatchFunc         = void (*)(const std::vector<size_t>& indices, Arg);
+    using PrefetchFunc      = void (*)(Arg, const std::atomic<bool>& cancelled);
+    using PrefetchErrorFunc = void (*)(size_t index, std::exception_ptr exception, Arg);
+
+    /// @brief The actions that keys and key sequences can be bound to.
+    enum KeyAction
+    {
+        KEY_ACTION_NONE = -1,
+        KEY_ACTION_CONFIRM = 0,
+        KEY_ACTION_EXIT,
+        KEY_ACTION_LEFT,
+        KEY_ACTION_UP,
+        KEY_ACTION_RIGHT,
+        KEY_ACTION_DOWN,
+        KEY_ACTION_PAGE_UP,
+        KEY_ACTION_PAGE_DOWN,
+        KEY_ACTION_HOME,
+        KEY_ACTION_END,
+        /// Toggle the highlighted option in multi-select mode.
+        KEY_ACTION_TOGGLE_SELECT,
+        /// Select the options from the last toggled one to the highlighted one in multi-select mode.
+        KEY_ACTION_SELECT_RANGE,
+        /// Select all options in multi-select mode, or clear the selection if all options are selected.
+        KEY_ACTION_SELECT_ALL,
+        /// The first user-defined action, see addKeyAction().
+        KEY_ACTION_USER
+    };
+
+    /// @brief The status of an option path executed by executePaths().
+    enum PathStatus
+    {
+        /// The callback of the option was executed.
+        PATH_STATUS_OK = 0,
+        /// A segment of the path matches no option, or an option in the middle of the path is not a submenu.
+        PATH_STATUS_NOT_FOUND,
+        /// The option has no callback, e.g. it is a submenu.
+        PATH_STATUS_NO_CALLBACK,
+        /// The callback threw an exception.
+        PATH_STATUS_FAILED
+    };
+
+    /// @brief The result of an option path executed by executePaths().
+    struct PathResult
+    {
+        std::string path;
+        PathStatus status;
+        /// Why the path failed, empty if the status is PATH_STATUS_OK.
+        std::string message;
+    };
 
-    CommandLineMenu() : shouldEndReceiveInput_(false) {};
+    CommandLineMenu() : model_(std::make_shared<Model>()), shouldEndReceiveInput_(false) {};
 
     ~CommandLineMenu() = default;
 
@@ -96,29 +197,79 @@ public:
     #ifdef _WIN32
         return ::_getch();
     #else
-        struct termios oldAttr, newAttr;
+        int key = EOF;
+        do
+            key = waitKey_(-1);
+        while (key == EOF && errno == EINTR);
 
-        tcgetattr(STDIN_FILENO, &oldAttr);
+        return key;
+    #endif // _WIN32
+    }
 
-        newAttr = oldAttr;
-        newAttr.c_lflag &= ~(ICANON | ECHO);
-        tcsetattr(STDIN_FILENO, TCSANOW, &newAttr);
+    /// @brief Make this menu a view of the other menu's definition.
+    /// @note - Options, texts, colors, keys and layout settings are shared, and a modification made through
+    /// any view is published to all views of the menu.
+    /// @note - The highlighted option and the input loop state are not shared, so each view can be shown and
+    /// navigated independently (e.g., by different threads).
+    /// @note - Readers take the current definition as a whole and never see a partial modification. The pointer to
+    /// it is loaded with std::atomic_load(), which most standard libraries (e.g., libstdc++) implement with a
+    /// short internal lock, so reads are consistent but not lock-free.
+    /// @attention Do not call this function while this menu is receiving input.
+    void shareModel(const CommandLineMenu& other)
+    {
+        model_ = other.model_;
+        selectedOption_ = 0;
+        selection_.clear();
+        selectionVersion_ = snapshot_()->optionListVersion;
+    }
 
-        int ch = getchar();
-        tcsetattr(STDIN_FILENO, TCSANOW, &oldAttr);
+    /// @brief Make several modifications of the menu and publish them to all views at once.
+    /// @note - Each modification otherwise copies the menu definition, so building a large menu option by
+    /// option takes quadratic time. Inside the editor the modifications are made in place instead.
+    /// @note - The editor is called with this menu. It is called again if another view publishes a modification
+    /// before it returns, so it should do nothing but modify the menu.
+    /// @note - The other views see none of the modifications until the editor returns.
+    /// If the editor throws an exception, none of the modifications are published.
+    /// @code
+    /// menu.edit([](CommandLineMenu& menu)
+    /// {
+    ///     for (int i = 0; i < 10000; ++i)
+    ///         menu.addOption("Option " + std::to_string(i), nullptr);
+    /// });
+    /// @endcode
+    /// @attention Do not call this function from the editor or from multiple threads on the same view.
+    template <typename Editor>
+    void edit(Editor editor)
+    {
+        SnapshotPtr current = std::atomic_load(&model_->current);
+        while (true)
+        {
+            draft_ = std::make_shared<Snapshot>(*current);
+            try
+            {
+                editor(*this);
+            }
+            catch (...)
+            {
+                draft_.reset();
+                throw;
+            }
 
-        return ch;
-    #endif // _WIN32
+            SnapshotPtr published = draft_;
+            draft_.reset();
+            if (std::atomic_compare_exchange_strong(&model_->current, &current, published))
+                return;
+        }
     }
 
     /// @brief Get the number of options in the menu.
-    size_t getOptionCount() const { return options_.size(); }
+    size_t getOptionCount() const { return snapshot_()->options.size(); }
 
-    std::string getOptionText(size_t index) const { return options_.at(index).text; }
+    std::string getOptionText(size_t index) const { return snapshot_()->options.at(index)->text; }
 
-    std::string getTopText() const { return topText_; }
+    std::string getTopText() const { return snapshot_()->topText; }
 
-    std::string getBottomText() const { return bottomText_; }
+    std::string getBottomText() const { return snapshot_()->bottomText; }
 
     /// @brief Add a new option to the end of the menu.
     /// @param optionText       The text displayed for the option.
@@ -127,9 +278,7 @@ public:
     void addOption(const std::string& optionText, VoidFunc callbackFunc,
         bool enableNewPage = true, bool waitKeyAfterEnd = true)
     {
-        options_.push_back(Option { enableNewPage, waitKeyAfterEnd, optionText, callbackFunc });
-        if (enableAutoAdjustOptionTextWidth_ && optionText.size() + reserveSpace > optionTextWidth_)
-            optionTextWidth_ = optionText.size() + reserveSpace;
+        insertOption_(SIZE_MAX, Option { enableNewPage, waitKeyAfterEnd, optionText, callbackFunc, nullptr, nullptr, nullptr });
     }
 
     /// @overload
@@ -141,9 +290,8 @@ public:
     void addOption(const std::string& optionText, ArgFunc callbackFunc, Arg arg,
         bool enableNewPage = true, bool waitKeyAfterEnd = true)
     {
-        options_.push_back(Option { enableNewPage, waitKeyAfterEnd, optionText, CallbackFunc(callbackFunc, arg) });
-        if (enableAutoAdjustOptionTextWidth_ && optionText.size() + reserveSpace > optionTextWidth_)
-            optionTextWidth_ = optionText.size() + reserveSpace;
+        insertOption_(SIZE_MAX,
+            Option { enableNewPage, waitKeyAfterEnd, optionText, CallbackFunc(callbackFunc, arg), nullptr, nullptr, nullptr });
     }
 
     /// @brief Insert a new option at the specified position.
@@ -154,9 +302,7 @@ public:
     void insertOption(size_t index, const std::string& optionText, VoidFunc callbackFunc,
         bool enableNewPage = true, bool waitKeyAfterEnd = true)
     {
-        options_.insert(options_.begin() + index, Option { enableNewPage, waitKeyAfterEnd, optionText, callbackFunc });
-        if (enableAutoAdjustOptionTextWidth_ && optionText.size() + reserveSpace > optionTextWidth_)
-            optionTextWidth_ = optionText.size() + reserveSpace;
+        insertOption_(index, Option { enableNewPage, waitKeyAfterEnd, optionText, callbackFunc, nullptr, nullptr, nullptr });
     }
 
     /// @overload
@@ -169,49 +315,85 @@ public:
     void insertOption(size_t index, const std::string& optionText, ArgFunc callbackFunc, Arg arg,
           bool enableNewPage = true, bool waitKeyAfterEnd = true)
     {
-        options_.insert(options_.begin() + index,
-            Option { enableNewPage, waitKeyAfterEnd, optionText, CallbackFunc(callbackFunc, arg) });
+        insertOption_(index,
+            Option { enableNewPage, waitKeyAfterEnd, optionText, CallbackFunc(callbackFunc, arg), nullptr, nullptr, nullptr });
+    }
+
+    /// @brief Add a new option to the end of the menu which opens the specified submenu.
+    /// @note The submenu is shown and receives input until it is exited, then this menu is shown again.
+    /// The submenu can also be reached by the option paths of executePaths().
+    /// @attention The submenu is referenced rather than copied, so it must outlive this menu.
+    void addSubmenuOption(const std::string& optionText, CommandLineMenu& submenu)
+    {
+        insertSubmenuOption(SIZE_MAX, optionText, submenu);
+    }
 
-        if (enableAutoAdjustOptionTextWidth_ && optionText.size() + reserveSpace > optionTextWidth_)
-            optionTextWidth_ = optionText.size() + reserveSpace;
+    /// @brief Insert a new option which opens the specified submenu at the specified index.
+    /// @sa addSubmenuOption()
+    void insertSubmenuOption(size_t index, const std::string& optionText, CommandLineMenu& submenu)
+    {
+        insertOption_(index, Option { true, false, optionText, nullptr, nullptr, nullptr, &submenu });
     }
 
     /// @brief Remove an option by its index.
-    void removeOption(size_t index) { options_.erase(options_.begin() + index); }
+    void removeOption(size_t index)
+    {
+        modify_([index](Snapshot& s)
+        {
+            s.options.erase(s.options.begin() + index);
+            ++s.optionListVersion;
+        });
+    }
 
     /// @brief Remove all options.
     void removeAllOption()
     {
-        options_.clear();
-        if (enableAutoAdjustOptionTextWidth_)
-            optionTextWidth_ = 0;
+        modify_([](Snapshot& s)
+        {
+            s.options.clear();
+            ++s.optionListVersion;
+            if (s.enableAutoAdjustOptionTextWidth)
+                s.optionTextWidth = 0;
+        });
     }
 
     /// @brief Enable or disable console clearing for the specified option.
-    void setOptionEnableNewPage(size_t index, bool enable) { options_[index].enableNewPage = enable; }
+    void setOptionEnableNewPage(size_t index, bool enable)
+    {
+        modifyOption_(index, [enable](Option& option) { option.enableNewPage = enable; });
+    }
 
     /// @brief Enable or disable whether to wait for any key input to return to the main menu when the function ends.
-    void setOptionWaitKeyAfterEnd(size_t index, bool enable) { options_[index].waitKeyAfterEnd = enable; }
+    void setOptionWaitKeyAfterEnd(size_t index, bool enable)
+    {
+        modifyOption_(index, [enable](Option& option) { option.waitKeyAfterEnd = enable; });
+    }
 
     /// @brief Set the display text for the specified option.
     void setOptionText(size_t index, const std::string& text)
     {
-        options_[index].text = text;
-        if (enableAutoAdjustOptionTextWidth_ && text.size() > optionTextWidth_)
-            optionTextWidth_ = text.size();
+        modify_([index, &text](Snapshot& s)
+        {
+            std::shared_ptr<Option> option = std::make_shared<Option>(*s.options.at(index));
+            option->text = text;
+            s.options[index] = option;
+
+            if (s.enableAutoAdjustOptionTextWidth && text.size() > s.optionTextWidth)
+                s.optionTextWidth = text.size();
+        });
     }
 
     /// @brief Set the callback function for the specified option.
     void setOptionCallback(size_t index, VoidFunc callbackFunc)
     {
-        options_[index].callback = CallbackFunc(callbackFunc);
+        modifyOption_(index, [callbackFunc](Option& option) { option.callback = CallbackFunc(callbackFunc); });
     }
 
     /// @overload
     /// @brief Set the callback function and argument for the specified option.
     void setOptionCallback(size_t index, ArgFunc callbackFunc, Arg arg)
     {
-        options_[index].callback = CallbackFunc(callbackFunc, arg);
+        modifyOption_(index, [callbackFunc, arg](Option& option) { option.callback = CallbackFunc(callbackFunc, arg); });
     }
 
     /// @brief Set the argument for the specified option's callback function.
@@ -219,67 +401,251 @@ public:
     /// @throw Throws std::runtime_error if the option does not have an argument-based callback.
     void setOptionCallbackArg(size_t index, Arg arg)
     {
-        if (options_[index].callback.isArgFunc)
-            options_[index].callback.argFuncArg.second = arg;
-        else
-            throw std::runtime_error("Specified option has no callback function with argument.");
+        modifyOption_(index, [arg](Option& option)
+        {
+            if (option.callback.isArgFunc)
+                option.callback.argFuncArg.second = arg;
+            else
+                throw std::runtime_error("Specified option has no callback function with argument.");
+        });
+    }
+
+    /// @brief Set the function that prefetches the data of the specified option in the background.
+    /// @note - The prefetch function is called on another thread once the option stays highlighted for the
+    /// prefetch delay (e.g., to build a submenu or load a data page), so that triggering the option is fast.
+    /// @note - cancelled is set when the highlight moves to another option, the function should return soon after.
+    /// @note - An option is prefetched at most once until it is triggered, and triggering it waits for
+    /// the running prefetch to finish, even if cancelled. The same function never runs on the same argument twice
+    /// at the same time.
+    /// @note - A failed prefetch does not prevent the callback, see setPrefetchErrorHandler().
+    /// @param prefetchFunc     The prefetch function, null to disable prefetching.
+    /// @param arg              The argument to pass to the prefetch function.
+    void setOptionPrefetch(size_t index, PrefetchFunc prefetchFunc, Arg arg)
+    {
+        modifyOption_(index, [prefetchFunc, arg](Option& option)
+        {
+            option.prefetchFunc = prefetchFunc;
+            option.prefetchArg = arg;
+        });
+    }
+
+    /// @brief Set the function called when an option whose prefetch threw an exception is triggered.
+    /// @note The handler is called on the thread triggering the option, before the callback of the option.
+    /// Without a handler, a failed prefetch is ignored, as if the option had not been prefetched.
+    void setPrefetchErrorHandler(PrefetchErrorFunc errorFunc, Arg arg)
+    {
+        modify_([errorFunc, arg](Snapshot& s)
+        {
+            s.prefetchErrorFunc = errorFunc;
+            s.prefetchErrorArg = arg;
+        });
     }
 
+    /// @brief Set how long an option stays highlighted before it is prefetched, in milliseconds. Default is 300.
+    void setPrefetchDelay(int milliseconds) { modify_([milliseconds](Snapshot& s) { s.prefetchDelay = milliseconds; }); }
+
+    /// @brief Set the maximum number of prefetches running at the same time. Default is 1.
+    /// @note Cancelled prefetches count until they return. A value of 0 disables prefetching.
+    void setMaxPrefetchCount(size_t count) { modify_([count](Snapshot& s) { s.maxPrefetchCount = count; }); }
+
     /// @brief Enable or disable index display for each option.
-    void setEnableShowIndex(bool enable) { enableShowIndex_ = enable; }
+    /// @note When enabled, typing the digits of an index (not bound to any action) jumps to that option.
+    void setEnableShowIndex(bool enable) { modify_([enable](Snapshot& s) { s.enableShowIndex = enable; }); }
 
     /// @brief Enable or disable automatic adjustment of option text width.
     /// @attention Call this function before addOption() or insertOption() for best results.
-    void setEnableAutoAdjustOptionTextWidth(bool enable) { enableAutoAdjustOptionTextWidth_ = enable; }
+    void setEnableAutoAdjustOptionTextWidth(bool enable)
+    {
+        modify_([enable](Snapshot& s) { s.enableAutoAdjustOptionTextWidth = enable; });
+    }
 
     /// @brief Set the column separator character. Default is '|'.
-    void setColumnSeparator(char separator) { columnSeparator_ = separator; }
+    void setColumnSeparator(char separator) { modify_([separator](Snapshot& s) { s.columnSeparator = separator; }); }
 
     /// @brief Set the row separator character. Default is '-'.
     /// @attention - Use '\0' to disable row separators.
     /// @attention - Row separators are not displayed if option text width is 0.
-    void setRowSeparator(char separator) { rowSeparator_ = separator; }
+    void setRowSeparator(char separator) { modify_([separator](Snapshot& s) { s.rowSeparator = separator; }); }
 
     /// @brief Set the text alignment for option display. Default is 0 (left-aligned).
     /// @note - 0: Left-justified
     /// @note - 1: Right-justified
     /// @note - 2: Center-justified
     /// @attention Alignment has no effect if option text width is 0.
-    void setOptionTextAlignment(int alignment) { optionTextAlignment_ = alignment; }
+    void setOptionTextAlignment(int alignment)
+    {
+        modify_([alignment](Snapshot& s) { s.optionTextAlignment = alignment; });
+    }
 
     /// @brief Set the key to confirm/select the highlighted option.
-    void setConfirmKey(int key) { confirmKey_ = key; }
+    /// @note Replaces the other single keys bound to KEY_ACTION_CONFIRM, key sequences are kept.
+    void setConfirmKey(int key) { modifyKeymap_([key](Keymap& keymap) { keymap.rebind(KEY_ACTION_CONFIRM, key); }); }
 
     /// @brief Set the key to exit the menu or return to parent menu.
-    void setExitKey(int key) { exitKey_ = key; }
+    /// @note Replaces the other single keys bound to KEY_ACTION_EXIT, key sequences are kept.
+    void setExitKey(int key) { modifyKeymap_([key](Keymap& keymap) { keymap.rebind(KEY_ACTION_EXIT, key); }); }
 
     /// @brief Set the directional keys for navigation.
+    /// @note Replaces the other single keys bound to the directional actions, key sequences (e.g., arrow keys)
+    /// are kept.
     void setDirectionalControlKey(int left, int up, int right, int down)
     {
-        directionalControlKey_ = { left, up, right, down };
+        setDirectionalControlKey({{ left, up, right, down }});
+    }
+
+    /// @overload
+    void setDirectionalControlKey(const std::array<int, 4>& keys)
+    {
+        modifyKeymap_([&keys](Keymap& keymap)
+        {
+            keymap.rebind(KEY_ACTION_LEFT, keys[0]);
+            keymap.rebind(KEY_ACTION_UP, keys[1]);
+            keymap.rebind(KEY_ACTION_RIGHT, keys[2]);
+            keymap.rebind(KEY_ACTION_DOWN, keys[3]);
+        });
+    }
+
+    /// @brief Bind a key to an action, in addition to the keys already bound to the action.
+    /// @param key      The key code, as returned by getkey() (0-255).
+    /// @param action   A KeyAction, or an action returned by addKeyAction().
+    /// @throw Throws std::out_of_range if the key code is out of range.
+    void bindKey(int key, int action) { bindKeySequence({ key }, action); }
+
+    /// @brief Bind a key sequence to an action, e.g., { 0x1B, '[', 'A' } for the up arrow key of most terminals.
+    /// @note A key that is also the prefix of a bound sequence (e.g., Escape) is dispatched once no further key
+    /// of the sequence arrives shortly after it.
+    /// @throw Throws std::out_of_range if the sequence is empty or a key code is out of range.
+    void bindKeySequence(const std::vector<int>& keys, int action)
+    {
+        modifyKeymap_([&keys, action](Keymap& keymap) { keymap.bind(keys, action); });
+    }
+
+    /// @brief Remove the binding of the specified key.
+    void unbindKey(int key) { unbindKeySequence({ key }); }
+
+    /// @brief Remove the binding of the specified key sequence.
+    void unbindKeySequence(const std::vector<int>& keys)
+    {
+        modifyKeymap_([&keys](Keymap& keymap) { keymap.unbind(keys); });
     }
 
+    /// @brief Remove all key bindings, including the default ones.
+    void unbindAllKeys() { modifyKeymap_([](Keymap& keymap) { keymap.unbindAll(); }); }
+
+    /// @brief Add a user-defined action that can be bound to keys.
+    /// @return The action to pass to bindKey() or bindKeySequence().
+    /// @note The menu is redrawn after the callback returns.
+    int addKeyAction(VoidFunc callbackFunc) { return addKeyAction_(CallbackFunc(callbackFunc)); }
+
     /// @overload
-    void setDirectionalControlKey(const std::array<int, 4>& keys) { directionalControlKey_ = keys; }
+    int addKeyAction(ArgFunc callbackFunc, Arg arg) { return addKeyAction_(CallbackFunc(callbackFunc, arg)); }
+
+    /// @brief Set the number of rows moved by KEY_ACTION_PAGE_UP and KEY_ACTION_PAGE_DOWN. Default is 10.
+    /// @attention A value of 0 has the same effect as 1.
+    void setPageSize(size_t rowCount) { modify_([rowCount](Snapshot& s) { s.pageSize = rowCount == 0 ? 1 : rowCount; }); }
+
+    /// @brief Enable or disable multi-select mode. Default is disabled.
+    /// @note - In multi-select mode, options are selected by KEY_ACTION_TOGGLE_SELECT (Space),
+    /// KEY_ACTION_SELECT_RANGE ('v') and KEY_ACTION_SELECT_ALL (Ctrl+A), and the confirm key triggers the
+    /// selected options as a batch, see triggerSelectedOptions().
+    /// @note - The selection belongs to the menu view, it is not shared by shareModel().
+    void setEnableMultiSelect(bool enable) { modify_([enable](Snapshot& s) { s.enableMultiSelect = enable; }); }
+
+    /// @brief Set the action executed for the selected options in multi-select mode.
+    /// @param batchFunc        The function receiving all selected indices at once. If null, the callbacks of the
+    /// selected options are executed, see setBatchThreadCount().
+    /// @param arg              The argument to pass to the batch function.
+    /// @param enableNewPage    Whether to clear the console before executing the batch.
+    /// @param waitKeyAfterEnd  Whether to wait for any key input after the batch ends.
+    void setBatchAction(BatchFunc batchFunc, Arg arg, bool enableNewPage = true, bool waitKeyAfterEnd = true)
+    {
+        modify_([batchFunc, arg, enableNewPage, waitKeyAfterEnd](Snapshot& s)
+        {
+            s.batchFunc = batchFunc;
+            s.batchArg = arg;
+            s.batchEnableNewPage = enableNewPage;
+            s.batchWaitKeyAfterEnd = waitKeyAfterEnd;
+        });
+    }
+
+    /// @brief Set the number of threads executing the callbacks of the selected options. Default is 1.
+    /// @note Only used if no batch function is set, a value of 0 has the same effect as 1.
+    /// @attention With more than one thread the callbacks run concurrently, so they must be thread-safe.
+    void setBatchThreadCount(size_t count)
+    {
+        modify_([count](Snapshot& s) { s.batchThreadCount = count == 0 ? 1 : count; });
+    }
+
+    /// @brief Select or deselect the specified option in multi-select mode.
+    /// @note The selection is cleared when options are inserted or removed through any view of the menu.
+    void setOptionSelected(size_t index, bool selected)
+    {
+        IndexSet& selection = currentSelection_(*snapshot_());
+        if (selected)
+            selection.insert(index);
+        else
+            selection.erase(index);
+    }
+
+    bool isOptionSelected(size_t index) const
+    {
+        return isSelectionCurrent_(*snapshot_()) && selection_.contains(index);
+    }
+
+    /// @brief Select all options in multi-select mode.
+    void selectAllOptions()
+    {
+        SnapshotPtr snapshot = snapshot_();
+        currentSelection_(*snapshot).insertRange(0, snapshot->options.size());
+    }
+
+    /// @brief Clear the selection of multi-select mode.
+    void clearSelectedOptions() { selection_.clear(); }
+
+    /// @brief Get the indices of the selected options in ascending order.
+    std::vector<size_t> getSelectedOptions() const
+    {
+        SnapshotPtr snapshot = snapshot_();
+        if (!isSelectionCurrent_(*snapshot))
+            return std::vector<size_t>();
+
+        return selection_.toVector(snapshot->options.size());
+    }
 
     /// @brief Set the maximum number of columns for menu layout. Default is 1.
     /// @attention A value of 0 has the same effect as 1.
-    void setMaxColumn(size_t maxColumn) { maxColumn_ = maxColumn == 0 ? 1 : maxColumn; }
+    void setMaxColumn(size_t maxColumn)
+    {
+        modify_([maxColumn](Snapshot& s) { s.maxColumn = maxColumn == 0 ? 1 : maxColumn; });
+    }
 
     /// @brief Set the fixed width for option text display. Default is 0 (auto-width).
     /// @note - If option text exceeds this width, it will be truncated with "...".
     /// @note - If option text is shorter, spaces will be added based on alignment.
     /// @note - A value of 0 disables text justification and row separators.
-    void setOptionTextWidth(size_t width) { optionTextWidth_ = width; }
+    void setOptionTextWidth(size_t width) { modify_([width](Snapshot& s) { s.optionTextWidth = width; }); }
+
+    /// @brief Enable or disable the reflow of the menu when the terminal is resized. Default is disabled.
+    /// @note - The column count and then the option text width are reduced to fit the terminal width,
+    /// and the menu is repainted once each time the terminal stops being resized.
+    /// @note - On Windows the terminal width is checked when a key is received.
+    /// @attention Reflow has no effect if option text width is 0.
+    void setEnableAutoReflow(bool enable) { modify_([enable](Snapshot& s) { s.enableAutoReflow = enable; }); }
 
     /// @brief Set the currently highlighted option.
     /// @attention If the index is out of range, the last option will be selected.
     void setHighlightedOption(size_t index)
     {
-        if (index >= options_.size())
-            setHighlightedOption(options_.size() - 1);
-        else
-            selectedOption_ = index;
+        SnapshotPtr snapshot = snapshot_();
+        size_t count = snapshot->options.size();
+        index = index < count ? index : (count == 0 ? 0 : count - 1);
+        if (index == selectedOption_)
+            return;
+
+        selectedOption_ = index;
+        highlightTime_ = std::chrono::steady_clock::now();
+        if (index < count)
+            prefetcher_.cancelExcept(snapshot->options[index].get());
     }
 
     /// @brief Select the specified option (alias for setHighlightedOption).
@@ -287,78 +653,217 @@ public:
     void selectOption(size_t index) { setHighlightedOption(index); }
 
     /// @brief Set the background color for option text. Default uses console default.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
     /// @note Invalid RGB values (e.g., [-1, -1, -1]) restore console default colors.
-    void setBackgroundColor(int r, int g, int b) { backgroundColor_ = { r, g, b }; }
-#else
-    void setBackgroundColor(Rgb color) { backgroundColor_ = color; }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+    void setBackgroundColor(int r, int g, int b) { setColor_(&Snapshot::backgroundColor, rgbColor_(r, g, b)); }
 
     /// @brief Set the foreground color for option text. Default uses console default.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
     /// @note Invalid RGB values (e.g., [-1, -1, -1]) restore console default colors.
-    void setForegroundColor(int r, int g, int b) { foregroundColor_ = { r, g, b }; }
-#else
-    void setForegroundColor(Rgb color) { foregroundColor_ = color; }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+    void setForegroundColor(int r, int g, int b) { setColor_(&Snapshot::foregroundColor, rgbColor_(r, g, b)); }
 
     /// @brief Set the background color for the highlighted option. Default uses console default.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
     /// @note Invalid RGB values (e.g., [-1, -1, -1]) restore console default colors.
-    void setHighlightBackgroundColor(int r, int g, int b) { highlightBackgroundColor_ = { r, g, b }; }
-#else
-    void setHighlightBackgroundColor(Rgb color) { highlightBackgroundColor_ = color; }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+    void setHighlightBackgroundColor(int r, int g, int b)
+    {
+        setColor_(&Snapshot::highlightBackgroundColor, rgbColor_(r, g, b));
+    }
 
     /// @brief Set the foreground color for the highlighted option. Default is green.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
     /// @note Invalid RGB values (e.g., [-1, -1, -1]) restore console default colors.
-    void setHighlightForegroundColor(int r, int g, int b) { highlightForegroundColor_ = { r, g, b }; }
-#else
-    void setHighlightForegroundColor(Rgb color) { highlightForegroundColor_ = color; }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+    void setHighlightForegroundColor(int r, int g, int b)
+    {
+        setColor_(&Snapshot::highlightForegroundColor, rgbColor_(r, g, b));
+    }
+
+#ifndef COMMAND_LINE_MENU_USE_24BIT_COLOR
+    /// @overload
+    /// @brief Set the background color for option text with an ANSI 256 color.
+    void setBackgroundColor(Rgb color) { setColor_(&Snapshot::backgroundColor, paletteColor_(color)); }
+
+    /// @overload
+    /// @brief Set the foreground color for option text with an ANSI 256 color.
+    void setForegroundColor(Rgb color) { setColor_(&Snapshot::foregroundColor, paletteColor_(color)); }
+
+    /// @overload
+    /// @brief Set the background color for the highlighted option with an ANSI 256 color.
+    void setHighlightBackgroundColor(Rgb color)
+    {
+        setColor_(&Snapshot::highlightBackgroundColor, paletteColor_(color));
+    }
+
+    /// @overload
+    /// @brief Set the foreground color for the highlighted option with an ANSI 256 color.
+    void setHighlightForegroundColor(Rgb color)
+    {
+        setColor_(&Snapshot::highlightForegroundColor, paletteColor_(color));
+    }
+#endif // !COMMAND_LINE_MENU_USE_24BIT_COLOR
+
+    /// @brief Set the color depth of the terminal. Default is detected by detectColorDepth().
+    void setColorDepth(ColorDepth depth) { colorDepth_ = depth; }
+
+    ColorDepth getColorDepth() const { return colorDepth_; }
+
+    /// @brief Detect the color depth of the terminal from the environment and the terminfo database.
+    /// @note - NO_COLOR, a "dumb" terminal or an output that is not a terminal disable colors.
+    /// @note - COLORTERM=truecolor (or 24bit) enables 24-bit colors, otherwise the "colors" capability
+    /// of the terminfo entry of TERM is used.
+    static ColorDepth detectColorDepth()
+    {
+        if (isColorDisabled_())
+            return COLOR_DEPTH_NONE;
+
+    #ifdef _WIN32
+        // The virtual terminal sequences of the Windows console support 24-bit colors.
+        return COLOR_DEPTH_TRUECOLOR;
+    #else
+        std::string termName = std::getenv("TERM");
+
+        const char* colorTerm = std::getenv("COLORTERM");
+        std::string colorTermName = colorTerm ? colorTerm : "";
+        if (colorTermName == "truecolor" || colorTermName == "24bit")
+            return COLOR_DEPTH_TRUECOLOR;
+
+        long colors = 0;
+        if (readTerminfoColors_(termName, colors))
+        {
+            if (colors >= 0x1000000)
+                return COLOR_DEPTH_TRUECOLOR;
+            if (colors >= 256)
+                return COLOR_DEPTH_256;
+            if (colors >= 8)
+                return COLOR_DEPTH_16;
+            return COLOR_DEPTH_NONE;
+        }
+
+        return termName.find("256color") != std::string::npos ? COLOR_DEPTH_256 : COLOR_DEPTH_16;
+    #endif // _WIN32
+    }
 
     /// @brief Set the text to display above the menu.
-    void setTopText(const std::string& text) { topText_ = text; }
+    void setTopText(const std::string& text) { modify_([&text](Snapshot& s) { s.topText = text; }); }
 
     /// @brief Set the text to display below the menu.
-    void setBottomText(const std::string& text) { bottomText_ = text; }
+    void setBottomText(const std::string& text) { modify_([&text](Snapshot& s) { s.bottomText = text; }); }
 
     /// @brief Select and trigger the specified option.
-    /// @attention No exception is thrown even if index is out of range or callback is null.
+    /// @attention No exception is thrown even if index is out of range or callback is null,
+    /// but the exceptions thrown by the callback and by the prefetch error handler propagate.
     void triggerOption(size_t index)
     {
-        if (index >= options_.size())
+        SnapshotPtr snapshot = snapshot_();
+        if (index >= snapshot->options.size())
             return;
 
         selectOption(index);
 
-        if (!options_[index].callback.isValid())
+        // Hold the option so that the callback can safely modify the menu.
+        OptionPtr option = snapshot->options[index];
+
+        // Use the prefetched data, and prefetch it again the next time.
+        std::exception_ptr prefetchException = prefetcher_.consume(option);
+        if (prefetchException && snapshot->prefetchErrorFunc)
+            snapshot->prefetchErrorFunc(index, prefetchException, snapshot->prefetchErrorArg);
+
+        if (option->submenu)
+            openSubmenu_(*option->submenu);
+        else
+            executeCallback_(option->callback, option->enableNewPage, option->waitKeyAfterEnd);
+
+        // Wait for the full dwell again before the option is prefetched again.
+        highlightTime_ = std::chrono::steady_clock::now();
+    }
+
+    /// @brief Trigger the selected options as a batch, then clear the selection.
+    /// @note The console is cleared and the key is waited for once for the whole batch.
+    /// @sa setBatchAction()
+    void triggerSelectedOptions()
+    {
+        SnapshotPtr snapshot = snapshot_();
+        std::vector<size_t> indices = currentSelection_(*snapshot).toVector(snapshot->options.size());
+        if (indices.empty())
             return;
 
-        if (options_[index].enableNewPage)
-            clearConsole();
+        selection_.clear();
+
+        if (snapshot->batchEnableNewPage)
+            clearConsole_();
 
-        options_[selectedOption_].callback.execute();
-        if (options_[selectedOption_].waitKeyAfterEnd)
+        if (snapshot->batchFunc)
+            snapshot->batchFunc(indices, snapshot->batchArg);
+        else
+            executeOptions_(snapshot->options, indices, snapshot->batchThreadCount);
+
+        if (snapshot->batchWaitKeyAfterEnd)
             getkey();
 
-        clearConsole();
+        clearConsole_();
     }
 
-    /// @brief Clear the console screen.
-    void clearConsole()
+    /// @brief Execute the callbacks of the specified options, without clearing the console or waiting for keys.
+    /// @param indices      The indices of the options, out of range indices and null callbacks are skipped.
+    /// @param threadCount  The number of threads executing the callbacks, the calling thread is one of them.
+    /// @note If a callback throws an exception, no more callbacks are started, and the first exception is rethrown
+    /// on the calling thread once the running callbacks have returned.
+    /// @attention With more than one thread the callbacks run concurrently, so they must be thread-safe.
+    void executeOptions(const std::vector<size_t>& indices, size_t threadCount = 1) const
     {
-    #ifdef _WIN32
-        ::system("cls");
-    #else
-        ::system("clear");
-    #endif // _WIN32
+        SnapshotPtr snapshot = snapshot_();
+        executeOptions_(snapshot->options, indices, threadCount);
+    }
+
+    /// @brief Execute the options at the specified paths without any terminal input or output, e.g. in scripts.
+    /// @note - A path is a list of segments separated by '/', e.g. "Sub Menu/Func 2" or "5/1". Each segment
+    /// selects an option of the current menu by its text, or by its index if no option text matches.
+    /// @note - The callbacks are called directly: the console is not cleared, the menu is not displayed and
+    /// no key is waited for after the callbacks.
+    /// @return The result of each path, in the same order as the paths.
+    std::vector<PathResult> executePaths(const std::vector<std::string>& paths) const
+    {
+        std::vector<PathResult> results;
+        results.reserve(paths.size());
+        for (const std::string& path : paths)
+            results.push_back(executePath_(path));
+
+        return results;
+    }
+
+    /// @overload
+    /// @brief Execute the options at the paths given as command line arguments, the program name argv[0] is skipped.
+    std::vector<PathResult> executePaths(int argc, const char* const argv[]) const
+    {
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; ++i)
+            paths.push_back(argv[i]);
+
+        return executePaths(paths);
+    }
+
+    /// @overload
+    /// @brief Execute the options at the paths read from the stream (e.g. std::cin), one path per line.
+    /// @note Empty lines are skipped.
+    std::vector<PathResult> executePaths(std::istream& input) const
+    {
+        std::vector<PathResult> results;
+        std::string path;
+        while (std::getline(input, path))
+        {
+            if (!path.empty() && path.back() == '\r')
+                path.pop_back();
+
+            if (!path.empty())
+                results.push_back(executePath_(path));
+        }
+
+        return results;
     }
 
+    /// @brief Clear the console screen.
+    void clearConsole() { clearConsole_(); }
+
     /// @brief Display the menu.
     void show()
     {
+        terminalWidth_ = queryTerminalWidth_();
         clearConsole();
         update_();
     }
@@ -367,295 +872,2221 @@ public:
     /// @attention This function blocks the current thread until the input loop is exited.
     void startReceiveInput()
     {
+        ResizeSignalGuard resizeSignalGuard(snapshot_()->enableAutoReflow);
+        handledResizeCount_ = resizeCount_();
+        highlightTime_ = std::chrono::steady_clock::now();
+
         while (!shouldEndReceiveInput_)
         {
-            int key = getkey();
-            if (key == confirmKey_)
-            {
-                triggerOption(selectedOption_);
-                update_();
-            }
-            else if (key == exitKey_)
-            {
-                shouldEndReceiveInput_ = true;
-            }
-            // Left
-            else if (key == directionalControlKey_[0])
+            reflowIfResized_();
+
+            int key = waitKey_(prefetchIfDwelled_());
+            // Interrupted by a signal (e.g., the terminal is resized) or time to check the prefetch.
+            if (key == EOF)
+                continue;
+
+            // Each key is handled against a single consistent version of the menu.
+            SnapshotPtr s = snapshot_();
+            int action = readKeyAction_(*s->keymap, key);
+
+            if (action == KEY_ACTION_NONE)
             {
-                if (selectedOption_ > 0)
+                size_t index = 0;
+                if (s->enableShowIndex && indexTyping_.type(key, s->options.size(), index) && index != selectedOption_)
                 {
-                    selectOption(selectedOption_ - 1);
+                    selectOption(index);
                     update_();
                 }
+
+                continue;
             }
-            // Up
-            else if (key == directionalControlKey_[1])
+
+            indexTyping_.reset();
+
+            size_t optionCount = s->options.size();
+            switch (action)
             {
-                size_t currentRow = selectedOption_ / maxCol_();
-                if (currentRow > 0)
-                {
-                    selectOption(selectedOption_ - maxCol_());
+                case KEY_ACTION_CONFIRM:
+                    if (s->enableMultiSelect && !currentSelection_(*s).empty(optionCount))
+                        triggerSelectedOptions();
+                    else
+                        triggerOption(selectedOption_);
                     update_();
-                }
-            }
-            // Right
-            else if (key == directionalControlKey_[2])
-            {
-                if (!options_.empty())
-                {
-                    if (selectedOption_ < options_.size() - 1)
+                    break;
+                case KEY_ACTION_EXIT:
+                    shouldEndReceiveInput_ = true;
+                    break;
+                case KEY_ACTION_TOGGLE_SELECT:
+                    if (s->enableMultiSelect && selectedOption_ < optionCount)
                     {
-                        selectOption(selectedOption_ + 1);
+                        currentSelection_(*s).toggle(selectedOption_);
+                        selectionAnchor_ = selectedOption_;
                         update_();
                     }
-                }
-            }
-            // Down
-            else if (key == directionalControlKey_[3])
-            {
-                if (!options_.empty())
+                    break;
+                case KEY_ACTION_SELECT_RANGE:
+                    if (s->enableMultiSelect && selectedOption_ < optionCount)
+                    {
+                        size_t first = selectionAnchor_ < selectedOption_ ? selectionAnchor_ : selectedOption_;
+                        size_t last = selectionAnchor_ < selectedOption_ ? selectedOption_ : selectionAnchor_;
+                        currentSelection_(*s).insertRange(first, last < optionCount ? last + 1 : optionCount);
+                        selectionAnchor_ = selectedOption_;
+                        update_();
+                    }
+                    break;
+                case KEY_ACTION_SELECT_ALL:
+                    if (s->enableMultiSelect)
+                    {
+                        IndexSet& selection = currentSelection_(*s);
+                        if (selection.count(optionCount) == optionCount)
+                            selection.clear();
+                        else
+                            selection.insertRange(0, optionCount);
+                        update_();
+                    }
+                    break;
+                default:
                 {
-                    size_t currentRow = selectedOption_ / maxCol_();
-                    size_t sumRow = (options_.size() - 1) / maxCol_() + 1;
-
-                    if (currentRow < sumRow - 1)
+                    if (action >= KEY_ACTION_USER)
                     {
-                        size_t expectedPos = selectedOption_ + maxCol_();
-                        expectedPos = expectedPos < options_.size() ? expectedPos : options_.size() - 1;
-
-                        if (expectedPos != selectedOption_)
+                        size_t actionIndex = static_cast<size_t>(action - KEY_ACTION_USER);
+                        if (actionIndex < s->keyActions.size() && s->keyActions[actionIndex].isValid())
                         {
-                            selectOption(expectedPos);
+                            s->keyActions[actionIndex].execute();
                             update_();
                         }
+
+                        break;
+                    }
+
+                    size_t target = moveHighlight_(selectedOption_, s->options.size(),
+                        gridLayout_(*s).columnCount, s->pageSize, action);
+                    if (target != selectedOption_)
+                    {
+                        selectOption(target);
+                        update_();
                     }
+
+                    break;
                 }
             }
         }
+
+        prefetcher_.cancelAll();
     }
 
     /// @brief End the input loop.
     /// @note This function is thread-safe.
     void endReceiveInput() { shouldEndReceiveInput_ = true; }
 
-private:
-    struct CallbackFunc
+    /// @brief An option of a menu defined at compile time.
+    /// @attention The callback must be usable in a constant expression, i.e. a function rather than a lambda.
+    struct StaticOption
     {
-        CallbackFunc(VoidFunc voidFunc) : isArgFunc(false), voidFunc(voidFunc) {}
+        constexpr StaticOption(const char* text, VoidFunc callback,
+            bool enableNewPage = true, bool waitKeyAfterEnd = true) :
+            text(text), callback(callback), enableNewPage(enableNewPage), waitKeyAfterEnd(waitKeyAfterEnd) {}
 
-        CallbackFunc(ArgFunc argFunc, Arg arg) : isArgFunc(true), argFuncArg(argFunc, arg) {}
+        const char* text;
+        VoidFunc callback;
+        bool enableNewPage;
+        bool waitKeyAfterEnd;
+    };
 
-        CallbackFunc(const CallbackFunc& other) : isArgFunc(other.isArgFunc)
+    /// @brief The layout of a menu defined at compile time.
+    /// @tparam MaxColumn       The maximum number of columns. A value of 0 has the same effect as 1.
+    /// @tparam Width           The option text width. A value of 0 fits the longest option text.
+    /// @tparam Alignment       The option text alignment. 0: Left, 1: Right, 2: Center.
+    /// @tparam ShowIndex       Whether to show the index of each option.
+    /// @tparam ColumnSeparator The column separator character.
+    /// @tparam RowSeparator    The row separator character, '\0' disables row separators.
+    template <size_t MaxColumn = 1, size_t Width = 0, int Alignment = 0, bool ShowIndex = false,
+        char ColumnSeparator = '|', char RowSeparator = '-'>
+    struct StaticLayout
+    {
+        static constexpr size_t maxColumn       = MaxColumn == 0 ? 1 : MaxColumn;
+        static constexpr size_t width           = Width;
+        static constexpr int alignment          = Alignment;
+        static constexpr bool showIndex         = ShowIndex;
+        static constexpr char columnSeparator   = ColumnSeparator;
+        static constexpr char rowSeparator      = RowSeparator;
+    };
+
+private:
+    // Reserve space to prevent index text from being truncated during auto-width adjustment.
+    static const size_t reserveSpace = 8;
+    // The width of the selection marker "[*] " or "[ ] " shown before each option in multi-select mode.
+    static const size_t selectionMarkerWidth = 4;
+    // The stored value of the console default color.
+    static const int noColor = -1;
+    // The flag of the stored RGB colors.
+    static const int rgbColorFlag = 0x1000000;
+    // The minimum option text width when reflowing, enough for a character and "...".
+    static const size_t minReflowOptionTextWidth = 4;
+    // Milliseconds without resize signals before the resize burst is considered settled.
+    static const int resizeSettleTime = 50;
+    // Milliseconds to wait for the next key of a key sequence.
+    static const int keySequenceTimeout = 50;
+    // Milliseconds within which the typed digits form a single option index.
+    static const int indexTypingTimeout = 1000;
+    // The maximum number of input loops woken up by a terminal resize, more loops reflow on the next key.
+    static const int maxResizeWakeups = 16;
+    // Milliseconds between the checks of the prefetch limit.
+    static const int prefetchRetryInterval = 50;
+    // Number of rows moved by page up and page down by default.
+    static const size_t defaultPageSize = 10;
+    // The maximum length of the default key sequences.
+    static const size_t maxDefaultKeySequenceLength = 4;
+
+    // Key bindings, each key of a sequence is dispatched by a table lookup.
+    class Keymap
+    {
+    public:
+        Keymap() : nodes_(1) {}
+
+        // Get the node reached by the key from the node (0 is the root), -1 if the key is not bound.
+        int next(int node, int key) const
         {
-            if (isArgFunc)
-                argFuncArg = other.argFuncArg;
-            else
-                voidFunc = other.voidFunc;
+            return key >= 0 && key < keyCount ? nodes_[node].next[key] : -1;
         }
 
-        CallbackFunc& operator=(const CallbackFunc& other)
+        // Whether a longer sequence continues from the node.
+        bool hasNext(int node) const { return nodes_[node].hasNext; }
+
+        // Get the action bound to the sequence ending at the node, KEY_ACTION_NONE if none.
+        int action(int node) const { return nodes_[node].action; }
+
+        void bind(const std::vector<int>& keys, int action)
         {
-            isArgFunc = other.isArgFunc;
+            if (keys.empty())
+                throw std::out_of_range("Empty key sequence.");
 
-            if (isArgFunc)
-                argFuncArg = other.argFuncArg;
-            else
-                voidFunc = other.voidFunc;
+            for (int key : keys)
+            {
+                if (key < 0 || key >= keyCount)
+                    throw std::out_of_range("Key code out of range.");
+            }
 
-            return *this;
+            bindings_[keys] = action;
+            rebuild_();
         }
 
-        bool isValid() const
+        void unbind(const std::vector<int>& keys)
         {
-            if (isArgFunc)
-                return argFuncArg.first;
-            else
-                return voidFunc;
+            bindings_.erase(keys);
+            rebuild_();
         }
 
-        void execute() const
+        void unbindAll()
         {
-            if (isArgFunc)
+            bindings_.clear();
+            rebuild_();
+        }
+
+        // Replace the single keys bound to the action with the key.
+        void rebind(int action, int key)
+        {
+            for (auto it = bindings_.begin(); it != bindings_.end();)
+            {
+                if (it->first.size() == 1 && it->second == action)
+                    it = bindings_.erase(it);
+                else
+                    ++it;
+            }
+
+            bind({ key }, action);
+        }
+
+    private:
+        static const int keyCount = 256;
+
+        struct Node
+        {
+            Node() : hasNext(false), action(KEY_ACTION_NONE) { next.fill(-1); }
+
+            std::array<int, keyCount> next;
+            bool hasNext;
+            int action;
+        };
+
+        // Rebuild the trie of the bindings, bindings change rarely so it is simply built from scratch.
+        void rebuild_()
+        {
+            nodes_.assign(1, Node());
+            for (const auto& binding : bindings_)
+            {
+                int node = 0;
+                for (int key : binding.first)
+                {
+                    if (nodes_[node].next[key] == -1)
+                    {
+                        nodes_[node].next[key] = static_cast<int>(nodes_.size());
+                        nodes_[node].hasNext = true;
+                        nodes_.push_back(Node());
+                    }
+
+                    node = nodes_[node].next[key];
+                }
+
+                nodes_[node].action = binding.second;
+            }
+        }
+
+        std::map<std::vector<int>, int> bindings_;
+        std::vector<Node> nodes_;
+    };
+
+    // A compact set of option indices, one bit per option.
+    class IndexSet
+    {
+    public:
+        bool contains(size_t index) const
+        {
+            return index / wordBits < words_.size() && (words_[index / wordBits] >> (index % wordBits) & 1) != 0;
+        }
+
+        void insert(size_t index) { word_(index) |= bit_(index); }
+
+        void erase(size_t index)
+        {
+            if (index / wordBits < words_.size())
+                words_[index / wordBits] &= ~bit_(index);
+        }
+
+        void toggle(size_t index) { word_(index) ^= bit_(index); }
+
+        // Insert the indices in [first, last).
+        void insertRange(size_t first, size_t last)
+        {
+            for (size_t index = first; index < last;)
+            {
+                // Fill whole words at once.
+                if (index % wordBits == 0 && last - index >= wordBits)
+                {
+                    word_(index) = ~std::uint64_t(0);
+                    index += wordBits;
+                }
+                else
+                {
+                    insert(index++);
+                }
+            }
+        }
+
+        void clear() { words_.clear(); }
+
+        // Whether no index below the limit is in the set.
+        bool empty(size_t limit) const { return count(limit) == 0; }
+
+        // Count the indices below the limit.
+        size_t count(size_t limit) const
+        {
+            size_t result = 0;
+            forEach_(limit, [&result](size_t) { ++result; });
+            return result;
+        }
+
+        // Get the indices below the limit in ascending order.
+        std::vector<size_t> toVector(size_t limit) const
+        {
+            std::vector<size_t> result;
+            forEach_(limit, [&result](size_t index) { result.push_back(index); });
+            return result;
+        }
+
+    private:
+        static const size_t wordBits = 64;
+
+        static std::uint64_t bit_(size_t index) { return std::uint64_t(1) << (index % wordBits); }
+
+        std::uint64_t& word_(size_t index)
+        {
+            if (index / wordBits >= words_.size())
+                words_.resize(index / wordBits + 1, 0);
+            return words_[index / wordBits];
+        }
+
+        template <typename Func>
+        void forEach_(size_t limit, Func func) const
+        {
+            for (size_t i = 0; i < words_.size() && i * wordBits < limit; ++i)
+            {
+                // Skip the empty words, and the empty bits by clearing the lowest set bit each time.
+                for (std::uint64_t word = words_[i]; word != 0; word &= word - 1)
+                {
+                    size_t bit = 0;
+                    while ((word >> bit & 1) == 0)
+                        ++bit;
+
+                    if (i * wordBits + bit >= limit)
+                        return;
+                    func(i * wordBits + bit);
+                }
+            }
+        }
+
+        std::vector<std::uint64_t> words_;
+    };
+
+    // Accumulates the digits typed to jump to an option index.
+    class IndexTyping
+    {
+    public:
+        // Type the key, return whether it completes a valid index.
+        // The digits typed shortly one after another form a single index, as long as it is in range.
+        bool type(int key, size_t optionCount, size_t& index)
+        {
+            if (key < '0' || key > '9')
+            {
+                reset();
+                return false;
+            }
+
+            size_t digit = static_cast<size_t>(key - '0');
+            auto now = std::chrono::steady_clock::now();
+            bool isContinued = typing_ && now - lastTime_ < std::chrono::milliseconds(static_cast<int>(indexTypingTimeout)) &&
+                index_ * 10 + digit < optionCount;
+
+            index_ = isContinued ? index_ * 10 + digit : digit;
+            typing_ = index_ < optionCount;
+            lastTime_ = now;
+
+            index = index_;
+            return typing_;
+        }
+
+        void reset() { typing_ = false; }
+
+    private:
+        bool typing_                                = false;
+        size_t index_                               = 0;
+        std::chrono::steady_clock::time_point lastTime_;
+    };
+
+    // A compile-time sequence of indices, like std::index_sequence of C++14.
+    template <size_t... I>
+    struct IndexSequence_ {};
+
+    template <typename First, typename Second>
+    struct ConcatIndexSequence_;
+
+    template <size_t... I, size_t... J>
+    struct ConcatIndexSequence_<IndexSequence_<I...>, IndexSequence_<J...>>
+    {
+        using type = IndexSequence_<I..., (sizeof...(I) + J)...>;
+    };
+
+    // Halve the sequence on each step to keep the template recursion depth logarithmic.
+    template <size_t N>
+    struct MakeIndexSequenceImpl_ : ConcatIndexSequence_<typename MakeIndexSequenceImpl_<N / 2>::type,
+        typename MakeIndexSequenceImpl_<N - N / 2>::type> {};
+
+    template <size_t N>
+    using MakeIndexSequence_ = typename MakeIndexSequenceImpl_<N>::type;
+
+    // A null-terminated string computed at compile time, the character k is Generator::at(k).
+    template <typename Generator, typename Indices>
+    struct ConstantString_;
+
+    template <typename Generator, size_t... I>
+    struct ConstantString_<Generator, IndexSequence_<I...>>
+    {
+        static constexpr char value[sizeof...(I) + 1] = { Generator::at(I)..., '\0' };
+    };
+
+    // An array of sizes computed at compile time, the element k is Generator::at(k).
+    template <typename Generator, typename Indices>
+    struct ConstantSizes_;
+
+    template <typename Generator, size_t... I>
+    struct ConstantSizes_<Generator, IndexSequence_<I...>>
+    {
+        static constexpr size_t value[sizeof...(I) + 1] = { Generator::at(I)..., 0 };
+    };
+
+    // Compile-time computation of the option texts of a StaticMenu.
+    template <size_t N, const StaticOption (&Options)[N], typename Layout>
+    struct StaticText_
+    {
+        static constexpr size_t length(const char* str) { return *str == '\0' ? 0 : 1 + length(str + 1); }
+
+        static constexpr size_t digitCount(size_t value) { return value < 10 ? 1 : 1 + digitCount(value / 10); }
+
+        static constexpr size_t power10(size_t exponent) { return exponent == 0 ? 1 : 10 * power10(exponent - 1); }
+
+        // The length of the index prefix "[i] ".
+        static constexpr size_t prefixLength(size_t i) { return Layout::showIndex ? digitCount(i) + 3 : 0; }
+
+        static constexpr size_t labelLength(size_t i) { return prefixLength(i) + length(Options[i].text); }
+
+        static constexpr size_t maxOf(size_t a, size_t b) { return a > b ? a : b; }
+
+        // The maximum label length of the options [first, last).
+        // Halve the range on each step to keep the constexpr recursion depth logarithmic.
+        static constexpr size_t maxLabelLength(size_t first, size_t last)
+        {
+            return last - first == 0 ? 0 : last - first == 1 ? labelLength(first) :
+                maxOf(maxLabelLength(first, first + (last - first) / 2), maxLabelLength(first + (last - first) / 2, last));
+        }
+
+        // The character k of the label (index prefix and text) of the option i.
+        static constexpr char labelChar(size_t i, size_t k)
+        {
+            return k >= prefixLength(i) ? Options[i].text[k - prefixLength(i)] :
+                k == 0 ? '[' :
+                k == prefixLength(i) - 2 ? ']' :
+                k == prefixLength(i) - 1 ? ' ' :
+                static_cast<char>('0' + i / power10(digitCount(i) - k) % 10);
+        }
+
+        // The left padding of a label of the specified length justified in the specified width.
+        static constexpr size_t padding(size_t length, size_t width)
+        {
+            return Layout::alignment == 1 ? width - length : Layout::alignment == 2 ? (width - length) / 2 : 0;
+        }
+
+        // The character p of the label of the option i justified in the specified width.
+        // The label length is passed in so that it is not recomputed for every character.
+        // A label longer than the width is truncated with "...".
+        static constexpr char cellChar(size_t i, size_t p, size_t width, size_t length)
+        {
+            return length > width ? (p + 3 >= width ? '.' : labelChar(i, p)) :
+                p < padding(length, width) || p >= padding(length, width) + length ? ' ' :
+                labelChar(i, p - padding(length, width));
+        }
+    };
+
+public:
+    /// @brief A menu defined entirely at compile time.
+    /// @note - The cell width, padded option texts and separator rows are computed during compilation,
+    /// so the menu is rendered straight from constant data without any construction cost or heap allocation.
+    /// @note - The options array is used as the callback dispatch table.
+    /// @tparam N       The number of options.
+    /// @tparam Options The options, must be a constexpr array with static storage duration.
+    /// @tparam Layout  The layout of the menu, see StaticLayout.
+    /// @code
+    /// constexpr CommandLineMenu::StaticOption options[] = { { "Func 1", func1 }, { "Func 2", func2 } };
+    /// CommandLineMenu::StaticMenu<2, options, CommandLineMenu::StaticLayout<2>> menu;
+    /// @endcode
+    template <size_t N, const StaticOption (&Options)[N], typename Layout = StaticLayout<>>
+    class StaticMenu
+    {
+    public:
+        static constexpr size_t optionCount         = N;
+        static constexpr size_t columnCount         = Layout::maxColumn < N ? Layout::maxColumn : N;
+        static constexpr size_t optionTextWidth     =
+            Layout::width != 0 ? Layout::width : StaticText_<N, Options, Layout>::maxLabelLength(0, N) + reserveSpace;
+        // Includes column separators.
+        static constexpr size_t rowWidth            = (optionTextWidth + 1) * columnCount + 1;
+
+        StaticMenu() : shouldEndReceiveInput_(false) {}
+
+        /// @brief Set the text to display above the menu.
+        /// @attention The text is not copied, so it must outlive the menu.
+        void setTopText(const char* text) { topText_ = text; }
+
+        /// @brief Set the text to display below the menu.
+        /// @attention The text is not copied, so it must outlive the menu.
+        void setBottomText(const char* text) { bottomText_ = text; }
+
+        /// @brief Set the currently highlighted option.
+        /// @attention If the index is out of range, the last option will be selected.
+        void setHighlightedOption(size_t index) { selectedOption_ = index < N ? index : N - 1; }
+
+        /// @brief Select and trigger the specified option.
+        /// @attention No exception is thrown even if index is out of range or callback is null.
+        void triggerOption(size_t index)
+        {
+            if (index >= N)
+                return;
+
+            setHighlightedOption(index);
+
+            const StaticOption& option = Options[index];
+            if (option.callback)
+                executeCallback_(option.callback, option.enableNewPage, option.waitKeyAfterEnd);
+        }
+
+        /// @brief Display the menu.
+        void show()
+        {
+            clearConsole_();
+            update_();
+        }
+
+        /// @brief Start receiving keyboard input for menu navigation.
+        /// @note The default key bindings of CommandLineMenu are used.
+        /// @attention This function blocks the current thread until the input loop is exited.
+        void startReceiveInput()
+        {
+            while (!shouldEndReceiveInput_)
+            {
+                int key = waitKey_(-1);
+                if (key == EOF)
+                    continue;
+
+                int action = readDefaultKeyAction_(key);
+                if (action == KEY_ACTION_NONE)
+                {
+                    size_t index = 0;
+                    if (Layout::showIndex && indexTyping_.type(key, N, index) && index != selectedOption_)
+                    {
+                        selectedOption_ = index;
+                        update_();
+                    }
+
+                    continue;
+                }
+
+                indexTyping_.reset();
+
+                if (action == KEY_ACTION_CONFIRM)
+                {
+                    triggerOption(selectedOption_);
+                    update_();
+                }
+                else if (action == KEY_ACTION_EXIT)
+                {
+                    shouldEndReceiveInput_ = true;
+                }
+                else
+                {
+                    size_t target = moveHighlight_(selectedOption_, N, columnCount, defaultPageSize, action);
+                    if (target != selectedOption_)
+                    {
+                        selectedOption_ = target;
+                        update_();
+                    }
+                }
+            }
+        }
+
+        /// @brief End the input loop.
+        /// @note This function is thread-safe.
+        void endReceiveInput() { shouldEndReceiveInput_ = true; }
+
+    private:
+        using Text = StaticText_<N, Options, Layout>;
+
+        struct LabelLengthGenerator
+        {
+            static constexpr size_t at(size_t i) { return Text::labelLength(i); }
+        };
+
+        // The label length of each option, computed once rather than for every character of the cells.
+        using LabelLengths      = ConstantSizes_<LabelLengthGenerator, MakeIndexSequence_<N>>;
+
+        // Generators of the constant strings, see ConstantString_.
+        struct CellGenerator
+        {
+            static constexpr char at(size_t k)
+            {
+                return Text::cellChar(k / optionTextWidth, k % optionTextWidth, optionTextWidth,
+                    LabelLengths::value[k / optionTextWidth]);
+            }
+        };
+
+        struct SeparatorGenerator
+        {
+            static constexpr char at(size_t k)
+            {
+                return k % (optionTextWidth + 1) == 0 ? Layout::columnSeparator : Layout::rowSeparator;
+            }
+        };
+
+        struct LastSeparatorGenerator
+        {
+            static constexpr char at(size_t) { return Layout::rowSeparator; }
+        };
+
+        struct SupplementGenerator
+        {
+            static constexpr char at(size_t k)
+            {
+                return k % (optionTextWidth + 1) == optionTextWidth ? Layout::columnSeparator : ' ';
+            }
+        };
+
+        // The width of the blank cells that fill the last row.
+        static constexpr size_t supplementWidth_ = (columnCount - 1 - (N - 1) % columnCount) * (optionTextWidth + 1);
+
+        // All justified option texts, one after another.
+        using Cells             = ConstantString_<CellGenerator, MakeIndexSequence_<N * optionTextWidth>>;
+        // The row separator with column separator markers.
+        using Separator         = ConstantString_<SeparatorGenerator, MakeIndexSequence_<rowWidth>>;
+        // The row separator of the top and the bottom of the menu.
+        using LastSeparator     = ConstantString_<LastSeparatorGenerator, MakeIndexSequence_<rowWidth>>;
+        // The blank cells that fill the last row.
+        using Supplement        = ConstantString_<SupplementGenerator, MakeIndexSequence_<supplementWidth_>>;
+
+        // Update the console display.
+        void update_() const
+        {
+            // The default highlight color as a base 16 color, which every color terminal supports.
+            static const char* const highlightSequence = isColorDisabled_() ? "" : "\x1b[32m";
+            bool hasRowSeparator = Layout::rowSeparator != '\0';
+
+            // Clear the console and move the cursor to the top-left corner.
+            std::cout << "\x1b[3J\x1b[H";
+
+            // Output the top text if not empty.
+            if (topText_ && *topText_ != '\0')
+                std::cout << topText_ << '\n' << std::endl;
+
+            // Output the top row separator if enabled.
+            if (hasRowSeparator)
+                std::cout.write(LastSeparator::value, rowWidth) << std::endl;
+
+            for (size_t i = 0; i < N; ++i)
+            {
+                std::cout << Layout::columnSeparator;
+
+                // Output option text with appropriate colors.
+                const char* text = Cells::value + i * optionTextWidth;
+                outputText_(text, optionTextWidth, i == selectedOption_ ? highlightSequence : "");
+
+                // Handle end-of-row formatting.
+                if (i % columnCount != columnCount - 1 && i != N - 1)
+                    continue;
+
+                // Output the final column separator.
+                std::cout << Layout::columnSeparator;
+
+                if (!hasRowSeparator)
+                {
+                    std::cout << std::endl;
+                    continue;
+                }
+
+                // Only the last row can be incomplete.
+                if (i == N - 1)
+                    std::cout.write(Supplement::value, supplementWidth_);
+
+                std::cout << std::endl;
+                std::cout.write(i == N - 1 ? LastSeparator::value : Separator::value, rowWidth) << std::endl;
+            }
+
+            // Output the bottom text if not empty.
+            if (bottomText_ && *bottomText_ != '\0')
+                std::cout << '\n' << bottomText_ << std::endl;
+
+            std::cout << std::endl << std::flush;
+        }
+
+        const char* topText_                = nullptr;
+        const char* bottomText_             = nullptr;
+        // Currently selected option index.
+        size_t selectedOption_              = 0;
+        // The digits typed to jump to an option.
+        IndexTyping indexTyping_;
+        // Flag to control input loop termination.
+        std::atomic<bool> shouldEndReceiveInput_;
+    };
+
+private:
+    struct CallbackFunc
+    {
+        CallbackFunc(VoidFunc voidFunc) : isArgFunc(false), voidFunc(voidFunc) {}
+
+        CallbackFunc(ArgFunc argFunc, Arg arg) : isArgFunc(true), argFuncArg(argFunc, arg) {}
+
+        CallbackFunc(const CallbackFunc& other) : isArgFunc(other.isArgFunc)
+        {
+            if (isArgFunc)
+                argFuncArg = other.argFuncArg;
+            else
+                voidFunc = other.voidFunc;
+        }
+
+        CallbackFunc& operator=(const CallbackFunc& other)
+        {
+            isArgFunc = other.isArgFunc;
+
+            if (isArgFunc)
+                argFuncArg = other.argFuncArg;
+            else
+                voidFunc = other.voidFunc;
+
+            return *this;
+        }
+
+        bool isValid() const
+        {
+            if (isArgFunc)
+                return argFuncArg.first;
+            else
+                return voidFunc;
+        }
+
+        void execute() const
+        {
+            if (isArgFunc)
                 argFuncArg.first(argFuncArg.second);
             else
                 voidFunc();
         }
 
-        bool isArgFunc;
-        union
+        bool isArgFunc;
+        union
+        {
+            VoidFunc voidFunc;
+            std::pair<ArgFunc, Arg> argFuncArg;
+        };
+    };
+
+    struct Option
+    {
+        bool enableNewPage;
+        bool waitKeyAfterEnd;
+        std::string text;
+        CallbackFunc callback;
+        PrefetchFunc prefetchFunc;
+        Arg prefetchArg;
+        // Opened instead of executing the callback if not null.
+        CommandLineMenu* submenu;
+    };
+
+    // Options are immutable once published, so the snapshots share the untouched ones.
+    using OptionPtr = std::shared_ptr<const Option>;
+
+    // An immutable version of the menu definition.
+    // A new snapshot is published for every modification, the published ones are never changed.
+    struct Snapshot
+    {
+        // Whether to show option indices.
+        bool enableShowIndex                        = false;
+        // Whether to auto-adjust option text width based on longest option.
+        bool enableAutoAdjustOptionTextWidth        = true;
+        // Column separator character. Default is '|'.
+        char columnSeparator                        = '|';
+        // Row separator character. Default is '-'.
+        // Use '\0' to disable.
+        char rowSeparator                           = '-';
+        // Text alignment for option display. Default is 0 (left-aligned).
+        // 0: left-justified, 1: right-justified, 2: center-justified.
+        int optionTextAlignment                     = 0;
+        // Key bindings, shared between snapshots until modified.
+        std::shared_ptr<const Keymap> keymap        = defaultKeymap_();
+        // User-defined key actions, indexed from KEY_ACTION_USER.
+        std::vector<CallbackFunc> keyActions;
+        // Number of rows moved by page up and page down.
+        size_t pageSize                             = defaultPageSize;
+        // Whether the options can be selected and triggered as a batch.
+        bool enableMultiSelect                      = false;
+        // Batch action of the selected options, see setBatchAction().
+        BatchFunc batchFunc                         = nullptr;
+        Arg batchArg                                = nullptr;
+        bool batchEnableNewPage                     = true;
+        bool batchWaitKeyAfterEnd                   = true;
+        // Number of threads executing the callbacks of the selected options without a batch function.
+        size_t batchThreadCount                     = 1;
+        // Milliseconds an option stays highlighted before it is prefetched.
+        int prefetchDelay                           = 300;
+        // Maximum number of prefetches running at the same time.
+        size_t maxPrefetchCount                     = 1;
+        // Called when an option whose prefetch failed is triggered, see setPrefetchErrorHandler().
+        PrefetchErrorFunc prefetchErrorFunc         = nullptr;
+        Arg prefetchErrorArg                        = nullptr;
+        // Maximum number of columns for layout.
+        // Default is 1. Value 0 is treated as 1.
+        size_t maxColumn                            = 1;
+        // Fixed width for option text display. Default is 0 (auto-width).
+        // 0 disables text justification and row separators.
+        size_t optionTextWidth                      = 0;
+        // Whether to fit the layout into the terminal width.
+        bool enableAutoReflow                       = false;
+        // Colors, see rgbColor_() and paletteColor_().
+        int backgroundColor                         = noColor;
+        int foregroundColor                         = noColor;
+        int highlightBackgroundColor                = noColor;
+    #ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
+        int highlightForegroundColor                = rgbColor_(0, 255, 0);
+    #else
+        int highlightForegroundColor                = paletteColor_(COLOR_GREEN);
+    #endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+        std::string topText;
+        std::string bottomText;
+        std::vector<OptionPtr> options;
+        // Incremented whenever options are inserted or removed, so that the views can tell that the option indices
+        // they hold (e.g., the selection) are stale.
+        std::uint64_t optionListVersion             = 0;
+    };
+
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+    // The published snapshot of a menu, shared by all views of the menu.
+    struct Model
+    {
+        Model() : current(std::make_shared<Snapshot>()) {}
+
+        // Only accessed through std::atomic_load() and std::atomic_compare_exchange_weak() or
+        // std::atomic_compare_exchange_strong(). These are usually implemented with a lock, not lock-free.
+        SnapshotPtr current;
+    };
+
+    // Runs the prefetch functions of the options on background threads.
+    // The results are kept by option rather than by index, so they stay valid when options are inserted or removed.
+    class Prefetcher
+    {
+    public:
+        Prefetcher() = default;
+
+        ~Prefetcher() { cancelAll(); }
+
+        Prefetcher(const Prefetcher& other) = delete;
+
+        Prefetcher& operator=(const Prefetcher& other) = delete;
+
+        // Whether the option is prefetched, its prefetch failed, or it is being prefetched and not cancelled.
+        bool contains(const OptionPtr& option)
+        {
+            reap_();
+            if (results_.count(option.get()) != 0)
+                return true;
+
+            for (const Task& task : tasks_)
+            {
+                if (task.option == option && !*task.cancelled)
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Whether a prefetch of the same work is running, even if cancelled.
+        // The work is not started again on the same argument until it returns.
+        bool isBusy(const Option& option)
+        {
+            reap_();
+            for (const Task& task : tasks_)
+            {
+                if (isSameWork_(*task.option, option))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Get the number of running prefetches, including the cancelled ones.
+        size_t runningCount()
+        {
+            reap_();
+            return tasks_.size();
+        }
+
+        void start(const OptionPtr& option)
+        {
+            Task task;
+            task.option = option;
+            task.cancelled = std::make_shared<std::atomic<bool>>(false);
+            task.finished = std::make_shared<std::atomic<bool>>(false);
+            task.exception = std::make_shared<std::exception_ptr>();
+
+            PrefetchFunc prefetchFunc = option->prefetchFunc;
+            Arg arg = option->prefetchArg;
+            std::shared_ptr<std::atomic<bool>> cancelled = task.cancelled;
+            std::shared_ptr<std::atomic<bool>> finished = task.finished;
+            std::shared_ptr<std::exception_ptr> exception = task.exception;
+            task.thread = std::thread([prefetchFunc, arg, cancelled, finished, exception]()
+            {
+                try
+                {
+                    prefetchFunc(arg, *cancelled);
+                }
+                catch (...)
+                {
+                    *exception = std::current_exception();
+                }
+
+                *finished = true;
+            });
+
+            tasks_.push_back(std::move(task));
+        }
+
+        // Cancel the prefetches of the other options, the finished ones keep their results.
+        void cancelExcept(const Option* option)
+        {
+            reap_();
+            for (Task& task : tasks_)
+            {
+                if (task.option.get() != option)
+                    *task.cancelled = true;
+            }
+        }
+
+        // Wait for every running prefetch of the same work as the option, including the cancelled ones,
+        // then forget the result of the option so that it is prefetched again the next time.
+        // Return the exception thrown by the prefetch of the option, null if none.
+        std::exception_ptr consume(const OptionPtr& option)
+        {
+            for (auto it = tasks_.begin(); it != tasks_.end();)
+            {
+                if (!isSameWork_(*it->option, *option))
+                {
+                    ++it;
+                    continue;
+                }
+
+                it->thread.join();
+                complete_(*it);
+                it = tasks_.erase(it);
+            }
+
+            auto result = results_.find(option.get());
+            if (result == results_.end())
+                return nullptr;
+
+            std::exception_ptr exception = result->second.exception;
+            results_.erase(result);
+            return exception;
+        }
+
+        // Cancel all prefetches and wait for them to return.
+        void cancelAll()
+        {
+            cancelExcept(nullptr);
+            for (Task& task : tasks_)
+                task.thread.join();
+
+            tasks_.clear();
+            results_.clear();
+        }
+
+    private:
+        struct Task
+        {
+            OptionPtr option;
+            std::shared_ptr<std::atomic<bool>> cancelled;
+            std::shared_ptr<std::atomic<bool>> finished;
+            // The exception thrown by the prefetch function, null if none.
+            std::shared_ptr<std::exception_ptr> exception;
+            std::thread thread;
+        };
+
+        struct Result
+        {
+            // Held so that the address of the option is not reused while it is a key of the results.
+            OptionPtr option;
+            // The exception thrown by the prefetch function, null if the option is prefetched.
+            std::exception_ptr exception;
+        };
+
+        // Whether the prefetches of the options run the same function on the same argument.
+        static bool isSameWork_(const Option& a, const Option& b)
+        {
+            return &a == &b || (a.prefetchFunc == b.prefetchFunc && a.prefetchArg == b.prefetchArg);
+        }
+
+        // Join the finished prefetches.
+        void reap_()
+        {
+            for (auto it = tasks_.begin(); it != tasks_.end();)
+            {
+                if (!*it->finished)
+                {
+                    ++it;
+                    continue;
+                }
+
+                it->thread.join();
+                complete_(*it);
+                it = tasks_.erase(it);
+            }
+        }
+
+        // Record the result of the joined prefetch, the results of the cancelled prefetches are discarded.
+        void complete_(const Task& task)
+        {
+            if (*task.cancelled)
+                return;
+
+            Result result;
+            result.option = task.option;
+            result.exception = *task.exception;
+            results_[task.option.get()] = result;
+        }
+
+        std::vector<Task> tasks_;
+        // The results of the options prefetched and not triggered yet.
+        std::map<const Option*, Result> results_;
+    };
+
+    static std::string cutoffString_(const std::string& str, size_t width)
+    {
+        if (str.size() <= width)
+            return str;
+        else
+            return str.substr(0, width - 3) + "...";
+    }
+
+    static std::string justifyString_(const std::string& str, size_t width, int alignment)
+    {
+        if (str.size() > width)
+            return justifyString_(cutoffString_(str, width), width, alignment);
+
+        switch (alignment)
+        {
+            case 0:
+                return str + std::string(width - str.size(), ' ');
+            case 1:
+                return std::string(width - str.size(), ' ') + str;
+            case 2:
+            {
+                std::string tmp = std::string((width - str.size()) / 2, ' ') + str;
+                tmp += std::string(width - tmp.size(), ' ');
+                return tmp;
+            }
+            default:
+                return str;
+        }
+    }
+
+    // Colors are stored as an int: noColor, an ANSI 256 color index, or rgbColorFlag with the RGB value.
+    static int rgbColor_(int r, int g, int b)
+    {
+        bool isValid = (r >= 0 && r <= 255) && (g >= 0 && g <= 255) && (b >= 0 && b <= 255);
+        return isValid ? rgbColorFlag | (r << 16) | (g << 8) | b : noColor;
+    }
+
+    static int paletteColor_(int index) { return index >= 0 && index <= 255 ? index : noColor; }
+
+    // The lookup tables to convert colors to the nearest color of a lower color depth, built once.
+    struct ColorTables
+    {
+        ColorTables()
+        {
+            static const int base16[16][3] = {
+                { 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+                { 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+                { 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+                { 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 }
+            };
+            static const int cubeValues[6] = { 0, 95, 135, 175, 215, 255 };
+
+            for (int i = 0; i < 16; ++i)
+                palette[i] = rgbColor_(base16[i][0], base16[i][1], base16[i][2]);
+            for (int i = 0; i < 216; ++i)
+                palette[16 + i] = rgbColor_(cubeValues[i / 36], cubeValues[i / 6 % 6], cubeValues[i % 6]);
+            for (int i = 0; i < 24; ++i)
+                palette[232 + i] = rgbColor_(8 + 10 * i, 8 + 10 * i, 8 + 10 * i);
+
+            for (int value = 0; value < 256; ++value)
+            {
+                int cube = 0;
+                for (int i = 1; i < 6; ++i)
+                {
+                    if (std::abs(cubeValues[i] - value) < std::abs(cubeValues[cube] - value))
+                        cube = i;
+                }
+
+                int gray = value < 8 ? 0 : (value - 3) / 10;
+                cubeLevel[value] = static_cast<unsigned char>(cube);
+                grayLevel[value] = static_cast<unsigned char>(gray > 23 ? 23 : gray);
+            }
+
+            for (int i = 0; i < 256; ++i)
+            {
+                int nearest = 0;
+                for (int j = 1; j < 16; ++j)
+                {
+                    if (distance(palette[i], palette[j]) < distance(palette[i], palette[nearest]))
+                        nearest = j;
+                }
+
+                base16Color[i] = static_cast<unsigned char>(i < 16 ? i : nearest);
+            }
+        }
+
+        static int distance(int color1, int color2)
+        {
+            int dr = (color1 >> 16 & 0xFF) - (color2 >> 16 & 0xFF);
+            int dg = (color1 >> 8 & 0xFF) - (color2 >> 8 & 0xFF);
+            int db = (color1 & 0xFF) - (color2 & 0xFF);
+            return dr * dr + dg * dg + db * db;
+        }
+
+        // Get the nearest ANSI 256 color of an RGB color, from the 6x6x6 cube or the gray steps.
+        int nearestPaletteColor(int color) const
+        {
+            int r = color >> 16 & 0xFF;
+            int g = color >> 8 & 0xFF;
+            int b = color & 0xFF;
+            int cube = 16 + 36 * cubeLevel[r] + 6 * cubeLevel[g] + cubeLevel[b];
+            int gray = 232 + grayLevel[(r + g + b) / 3];
+            return distance(color, palette[cube]) <= distance(color, palette[gray]) ? cube : gray;
+        }
+
+        // The RGB colors of the ANSI 256 colors (xterm defaults).
+        std::array<int, 256> palette;
+        // The nearest 6x6x6 cube level of a channel value.
+        std::array<unsigned char, 256> cubeLevel;
+        // The nearest gray step of a channel value.
+        std::array<unsigned char, 256> grayLevel;
+        // The nearest base 16 color of an ANSI 256 color.
+        std::array<unsigned char, 256> base16Color;
+    };
+
+    static const ColorTables& colorTables_()
+    {
+        static const ColorTables tables;
+        return tables;
+    }
+
+    // Whether colors are disabled by NO_COLOR, or the output is not a terminal supporting colors at all.
+    // Unlike detectColorDepth(), it reads no terminfo file and allocates nothing.
+    static bool isColorDisabled_()
+    {
+        const char* noColor = std::getenv("NO_COLOR");
+        if (noColor && *noColor != '\0')
+            return true;
+
+    #ifdef _WIN32
+        return false;
+    #else
+        if (!::isatty(STDOUT_FILENO))
+            return true;
+
+        const char* term = std::getenv("TERM");
+        return !term || *term == '\0' || std::strcmp(term, "dumb") == 0;
+    #endif // _WIN32
+    }
+
+    // The color depth detected once for the process.
+    static ColorDepth defaultColorDepth_()
+    {
+        static const ColorDepth depth = detectColorDepth();
+        return depth;
+    }
+
+    // Read the "colors" capability of the compiled terminfo entry of the terminal.
+    // Return false if the entry is not found.
+    static bool readTerminfoColors_(const std::string& term, long& colors)
+    {
+        std::vector<std::string> directories;
+        const char* terminfo = std::getenv("TERMINFO");
+        if (terminfo)
+            directories.push_back(terminfo);
+
+        const char* home = std::getenv("HOME");
+        if (home)
+            directories.push_back(std::string(home) + "/.terminfo");
+
+        const char* terminfoDirs = std::getenv("TERMINFO_DIRS");
+        std::string dirs = terminfoDirs ? terminfoDirs : "";
+        for (size_t begin = 0, end = 0; begin < dirs.size(); begin = end + 1)
+        {
+            end = dirs.find(':', begin);
+            end = end == std::string::npos ? dirs.size() : end;
+            if (end > begin)
+                directories.push_back(dirs.substr(begin, end - begin));
+        }
+
+        for (const char* directory : { "/etc/terminfo", "/lib/terminfo", "/usr/share/terminfo", "/usr/lib/terminfo" })
+            directories.push_back(directory);
+
+        static const char hexDigits[] = "0123456789abcdef";
+        std::string hexSubdirectory { hexDigits[(term[0] >> 4) & 0xF], hexDigits[term[0] & 0xF] };
+
+        for (const std::string& directory : directories)
+        {
+            // Entries are stored in a subdirectory named by the first character, or its hex code on macOS.
+            for (const std::string& subdirectory : { term.substr(0, 1), hexSubdirectory })
+            {
+                std::ifstream file(directory + "/" + subdirectory + "/" + term, std::ios::binary);
+                if (file && parseTerminfoColors_(file, colors))
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Parse the "colors" capability of a compiled terminfo entry, -1 if absent.
+    static bool parseTerminfoColors_(std::istream& file, long& colors)
+    {
+        // The legacy format stores numbers in 16 bits, the extended number format in 32 bits.
+        static const int legacyMagic = 0432;
+        static const int extendedMagic = 01036;
+        // The index of "colors" in the numbers section.
+        static const int colorsIndex = 13;
+
+        unsigned char header[12];
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+            return false;
+
+        int values[6];
+        for (int i = 0; i < 6; ++i)
+            values[i] = header[2 * i] | (header[2 * i + 1] << 8);
+
+        int magic = values[0];
+        if (magic != legacyMagic && magic != extendedMagic)
+            return false;
+
+        int namesSize = values[1];
+        int boolCount = values[2];
+        int numberCount = values[3];
+        int numberSize = magic == legacyMagic ? 2 : 4;
+
+        if (numberCount <= colorsIndex)
+        {
+            colors = -1;
+            return true;
+        }
+
+        // The numbers section is aligned to an even offset.
+        long offset = namesSize + boolCount;
+        offset += offset % 2;
+        file.seekg(offset + colorsIndex * numberSize, std::ios::cur);
+
+        unsigned char number[4] = { 0, 0, 0, 0 };
+        if (!file.read(reinterpret_cast<char*>(number), numberSize))
+            return false;
+
+        if (numberSize == 2)
+        {
+            int value = number[0] | (number[1] << 8);
+            colors = value >= 0x8000 ? -1 : value;
+        }
+        else
+        {
+            unsigned long value = number[0] | (number[1] << 8) | (number[2] << 16) |
+                (static_cast<unsigned long>(number[3]) << 24);
+            colors = value >= 0x80000000UL ? -1 : static_cast<long>(value);
+        }
+
+        return true;
+    }
+
+    // Get the SGR parameters of a color for the color depth, empty if the color is not output.
+    static std::string colorParameter_(int color, bool isBackground, ColorDepth depth)
+    {
+        if (color == noColor || depth == COLOR_DEPTH_NONE)
+            return std::string();
+
+        const ColorTables& tables = colorTables_();
+        bool isRgb = (color & rgbColorFlag) != 0;
+        std::string base = isBackground ? "4" : "3";
+
+        if (depth == COLOR_DEPTH_TRUECOLOR && isRgb)
+        {
+            return base + "8;2;" + std::to_string(color >> 16 & 0xFF) + ";" +
+                std::to_string(color >> 8 & 0xFF) + ";" + std::to_string(color & 0xFF);
+        }
+
+        int index = isRgb ? tables.nearestPaletteColor(color) : color;
+        if (depth != COLOR_DEPTH_16)
+            return base + "8;5;" + std::to_string(index);
+
+        // 30-37 and 40-47 for the normal colors, 90-97 and 100-107 for the bright colors.
+        index = tables.base16Color[index];
+        if (index < 8)
+            return base + std::to_string(index);
+        return (isBackground ? "10" : "9") + std::to_string(index - 8);
+    }
+
+    // The SGR sequences that set the option colors, empty if no attribute is set.
+    // Built only when the colors or the color depth change, so the colors cost nothing per frame.
+    struct ColorSequences
+    {
+        std::string normal;
+        std::string highlight;
+    };
+
+    static ColorSequences makeColorSequences_(const Snapshot& s, ColorDepth depth)
+    {
+        ColorSequences sequences;
+        sequences.normal = makeColorSequence_(s.foregroundColor, s.backgroundColor, depth);
+        sequences.highlight = makeColorSequence_(s.highlightForegroundColor, s.highlightBackgroundColor, depth);
+        return sequences;
+    }
+
+    static std::string makeColorSequence_(int foregroundColor, int backgroundColor, ColorDepth depth)
+    {
+        std::string foreground = colorParameter_(foregroundColor, false, depth);
+        std::string background = colorParameter_(backgroundColor, true, depth);
+        if (foreground.empty() && background.empty())
+            return std::string();
+
+        std::string separator = foreground.empty() || background.empty() ? "" : ";";
+        return "\x1b[" + foreground + separator + background + "m";
+    }
+
+    // Output text with the SGR sequence, the attributes are reset after the text.
+    static void outputText_(const char* text, size_t size, const char* colorSequence)
+    {
+        if (*colorSequence == '\0')
+        {
+            std::cout.write(text, size);
+            return;
+        }
+
+        std::cout << colorSequence;
+        std::cout.write(text, size);
+        std::cout << "\x1b[0m";
+    }
+
+    // Execute the callbacks of the options, distributed over the threads.
+    // The first exception thrown by a callback is rethrown after all threads finish.
+    static void executeOptions_(const std::vector<OptionPtr>& options, const std::vector<size_t>& indices,
+        size_t threadCount)
+    {
+        std::atomic<size_t> next(0);
+        std::exception_ptr firstException;
+        std::mutex exceptionMutex;
+        auto worker = [&options, &indices, &next, &firstException, &exceptionMutex]()
+        {
+            try
+            {
+                for (size_t i = next++; i < indices.size(); i = next++)
+                {
+                    if (indices[i] < options.size() && options[indices[i]]->callback.isValid())
+                        options[indices[i]]->callback.execute();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (!firstException)
+                    firstException = std::current_exception();
+
+                // Start no more callbacks, as a single thread would.
+                next = indices.size();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < threadCount && i < indices.size(); ++i)
+            threads.emplace_back(worker);
+
+        worker();
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        if (firstException)
+            std::rethrow_exception(firstException);
+    }
+
+    // Find the option of the menu by its text, or by its index if no option text matches.
+    static OptionPtr findOption_(const Snapshot& s, const std::string& segment)
+    {
+        for (const OptionPtr& option : s.options)
+        {
+            if (option->text == segment)
+                return option;
+        }
+
+        if (segment.empty() || segment.find_first_not_of("0123456789") != std::string::npos)
+            return nullptr;
+
+        size_t index = 0;
+        for (char ch : segment)
+        {
+            index = index * 10 + static_cast<size_t>(ch - '0');
+            if (index >= s.options.size())
+                return nullptr;
+        }
+
+        return s.options[index];
+    }
+
+    // Resolve the option path through the submenus and execute the callback of the option it ends at.
+    PathResult executePath_(const std::string& path) const
+    {
+        PathResult result { path, PATH_STATUS_OK, std::string() };
+
+        const CommandLineMenu* menu = this;
+        OptionPtr option;
+        for (size_t begin = 0, end = 0; begin <= path.size(); begin = end + 1)
+        {
+            end = path.find('/', begin);
+            if (end == std::string::npos)
+                end = path.size();
+
+            if (option)
+            {
+                if (!option->submenu)
+                {
+                    result.status = PATH_STATUS_NOT_FOUND;
+                    result.message = "'" + option->text + "' is not a submenu";
+                    return result;
+                }
+
+                menu = option->submenu;
+            }
+
+            std::string segment = path.substr(begin, end - begin);
+            option = findOption_(*menu->snapshot_(), segment);
+            if (!option)
+            {
+                result.status = PATH_STATUS_NOT_FOUND;
+                result.message = "no option '" + segment + "'";
+                return result;
+            }
+        }
+
+        if (!option->callback.isValid())
+        {
+            result.status = PATH_STATUS_NO_CALLBACK;
+            result.message = "'" + option->text + (option->submenu ? "' is a submenu" : "' has no callback");
+            return result;
+        }
+
+        try
+        {
+            option->callback.execute();
+        }
+        catch (const std::exception& e)
+        {
+            result.status = PATH_STATUS_FAILED;
+            result.message = e.what();
+        }
+        catch (...)
+        {
+            result.status = PATH_STATUS_FAILED;
+            result.message = "unknown exception";
+        }
+
+        return result;
+    }
+
+    // Show the submenu and receive input for it until it is exited.
+    static void openSubmenu_(CommandLineMenu& submenu)
+    {
+        submenu.shouldEndReceiveInput_ = false;
+        submenu.show();
+        submenu.startReceiveInput();
+        clearConsole_();
+    }
+
+    // Clear the console screen.
+    static void clearConsole_()
+    {
+    #ifdef _WIN32
+        ::system("cls");
+    #else
+        ::system("clear");
+    #endif // _WIN32
+    }
+
+    // Execute the callback of an option, do nothing if the callback is null.
+    static void executeCallback_(const CallbackFunc& callback, bool enableNewPage, bool waitKeyAfterEnd)
+    {
+        if (!callback.isValid())
+            return;
+
+        if (enableNewPage)
+            clearConsole_();
+
+        callback.execute();
+        if (waitKeyAfterEnd)
+            getkey();
+
+        clearConsole_();
+    }
+
+    // Get the option index after moving the highlight by the specified navigation action.
+    static size_t moveHighlight_(size_t selected, size_t optionCount, size_t maxCol, size_t pageSize, int action)
+    {
+        if (optionCount == 0)
+            return selected;
+
+        size_t currentRow = selected / maxCol;
+        size_t lastRow = (optionCount - 1) / maxCol;
+
+        switch (action)
+        {
+            case KEY_ACTION_LEFT:
+                return selected > 0 ? selected - 1 : selected;
+            case KEY_ACTION_UP:
+                return currentRow > 0 ? selected - maxCol : selected;
+            case KEY_ACTION_RIGHT:
+                return selected < optionCount - 1 ? selected + 1 : selected;
+            case KEY_ACTION_DOWN:
+            {
+                if (currentRow >= lastRow)
+                    return selected;
+
+                size_t expectedPos = selected + maxCol;
+                return expectedPos < optionCount ? expectedPos : optionCount - 1;
+            }
+            // Keep the column, stop at the first or the last row.
+            case KEY_ACTION_PAGE_UP:
+                return currentRow > pageSize ? selected - pageSize * maxCol : selected % maxCol;
+            case KEY_ACTION_PAGE_DOWN:
+            {
+                size_t row = lastRow - currentRow > pageSize ? currentRow + pageSize : lastRow;
+                size_t expectedPos = row * maxCol + selected % maxCol;
+                return expectedPos < optionCount ? expectedPos : optionCount - 1;
+            }
+            case KEY_ACTION_HOME:
+                return 0;
+            case KEY_ACTION_END:
+                return optionCount - 1;
+            default:
+                return selected;
+        }
+    }
+
+    // Read the rest of the key sequence started by the key, return the bound action or KEY_ACTION_NONE.
+    static int readKeyAction_(const Keymap& keymap, int key)
+    {
+        int node = keymap.next(0, key);
+        while (node != -1 && keymap.hasNext(node))
         {
-            VoidFunc voidFunc;
-            std::pair<ArgFunc, Arg> argFuncArg;
-        };
-    };
+            // The key may be complete by itself (e.g., Escape), so only wait shortly for the rest.
+            int nextKey = waitKey_(keySequenceTimeout);
+            if (nextKey == EOF)
+                break;
 
-    struct Option
+            node = keymap.next(node, nextKey);
+        }
+
+        return node == -1 ? KEY_ACTION_NONE : keymap.action(node);
+    }
+
+    // Read the rest of the key sequence started by the key against the default key bindings,
+    // by scanning the constant bindings rather than building a Keymap.
+    static int readDefaultKeyAction_(int key)
     {
-        bool enableNewPage;
-        bool waitKeyAfterEnd;
-        std::string text;
-        CallbackFunc callback;
+        int keys[maxDefaultKeySequenceLength] = { key };
+        size_t length = 1;
+
+        while (true)
+        {
+            int action = KEY_ACTION_NONE;
+            bool hasNext = false;
+            for (const KeyBinding* binding = defaultKeyBindings_(); binding->length != 0; ++binding)
+            {
+                if (binding->length < length || !std::equal(keys, keys + length, binding->keys))
+                    continue;
+
+                if (binding->length == length)
+                    action = binding->action;
+                else
+                    hasNext = true;
+            }
+
+            if (!hasNext)
+                return action;
+
+            // The key may be complete by itself (e.g., Escape), so only wait shortly for the rest.
+            int nextKey = waitKey_(keySequenceTimeout);
+            if (nextKey == EOF)
+                return action;
+
+            keys[length++] = nextKey;
+        }
+    }
+
+    static size_t maxCol_(const Snapshot& s)
+    {
+        return s.maxColumn < s.options.size() ? s.maxColumn : s.options.size();
+    }
+
+    // Get the terminal width in characters, 0 if unknown.
+    static size_t queryTerminalWidth_()
+    {
+    #ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (!::GetConsoleScreenBufferInfo(::GetStdHandle(STD_OUTPUT_HANDLE), &info))
+            return 0;
+        return static_cast<size_t>(info.srWindow.Right - info.srWindow.Left + 1);
+    #else
+        struct winsize size;
+        if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0)
+            return 0;
+        return size.ws_col;
+    #endif // _WIN32
+    }
+
+    // Wait for a key at most the timeout in milliseconds, a negative timeout waits forever.
+    // Return EOF if the timeout expires or the wait is interrupted by a signal.
+    static int waitKey_(int timeout)
+    {
+    #ifdef _WIN32
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        while (timeout >= 0 && !::_kbhit())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return EOF;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return ::_getch();
+    #else
+        struct termios oldAttr, newAttr;
+
+        tcgetattr(STDIN_FILENO, &oldAttr);
+
+        newAttr = oldAttr;
+        newAttr.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &newAttr);
+
+        // Keys are read through stdio, so a key left in the stdin buffer (e.g., the line feed after std::cin >> n)
+        // is read first.
+        int key = readBufferedKey_();
+        if (key == EOF)
+        {
+            // poll() is never restarted after a signal handler, and the resize signal handler also writes to
+            // the wake-up pipe, so a resize just before poll() is called still wakes it up.
+            errno = 0;
+            int wakeFd = resizeWakeFd_();
+            struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+            if (::poll(fds, wakeFd == -1 ? 1 : 2, timeout) > 0)
+            {
+                if (fds[1].revents & POLLIN)
+                {
+                    char buffer[64];
+                    while (::read(wakeFd, buffer, sizeof(buffer)) > 0) {}
+                    errno = EINTR;
+                }
+                else
+                {
+                    key = readBufferedKey_();
+                }
+            }
+        }
+
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldAttr);
+
+        return key;
+    #endif // _WIN32
+    }
+
+#ifndef _WIN32
+    // Read a key through stdio without blocking, EOF if none is buffered or ready.
+    // The input is shared with the shell and the other jobs of the terminal, so it is only made non-blocking
+    // around the read itself, never while waiting.
+    static int readBufferedKey_()
+    {
+        int flags = ::fcntl(STDIN_FILENO, F_GETFL);
+        ::fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+
+        int key = std::getchar();
+        if (key == EOF)
+            std::clearerr(stdin);
+
+        ::fcntl(STDIN_FILENO, F_SETFL, flags);
+        return key;
+    }
+#endif // !_WIN32
+
+    // The number of terminal resize signals received.
+    // Constant initialized, so it is safe to access from the signal handler.
+    static volatile std::sig_atomic_t& resizeCount_()
+    {
+        static volatile std::sig_atomic_t count = 0;
+        return count;
+    }
+
+#ifndef _WIN32
+    // The terminal resize signal handler state, shared by all menus of the process.
+    // Created before the handler is first installed, the handler only accesses plain data and lock-free atomics.
+    struct ResizeSignalState
+    {
+        std::mutex mutex;
+        // Number of input loops that have the handler installed.
+        int installCount;
+        struct sigaction previous;
+        // A non-blocking wake-up pipe per input loop, created on first use and kept for the process lifetime,
+        // so that the handler never writes to a closed descriptor.
+        int wakePipes[maxResizeWakeups][2];
+        bool isWakePipeCreated[maxResizeWakeups];
+        // Whether the wake-up pipe is used by an input loop.
+        std::atomic<bool> isWakePipeActive[maxResizeWakeups];
     };
 
-    static std::string cutoffString_(const std::string& str, size_t width)
+    static ResizeSignalState& resizeSignalState_()
     {
-        if (str.size() <= width)
-            return str;
-        else
-            return str.substr(0, width - 3) + "...";
+        static ResizeSignalState state;
+        return state;
     }
 
-    static std::string justifyString_(const std::string& str, size_t width, int alignment)
+    static void onResizeSignal_(int)
     {
-        if (str.size() > width)
-            return justifyString_(cutoffString_(str, width), width, alignment);
+        int savedErrno = errno;
+        resizeCount_() = resizeCount_() + 1;
 
-        switch (alignment)
+        ResizeSignalState& state = resizeSignalState_();
+        for (int i = 0; i < maxResizeWakeups; ++i)
         {
-            case 0:
-                return str + std::string(width - str.size(), ' ');
-            case 1:
-                return std::string(width - str.size(), ' ') + str;
-            case 2:
+            char byte = 0;
+            if (state.isWakePipeActive[i] && ::write(state.wakePipes[i][1], &byte, 1) < 0) {}
+        }
+
+        errno = savedErrno;
+    }
+#endif // !_WIN32
+
+    // The read end of the wake-up pipe of the input loop running on this thread, -1 if none.
+    static int& resizeWakeFd_()
+    {
+        static thread_local int fd = -1;
+        return fd;
+    }
+
+    // Install the terminal resize signal handler in the scope, the previous handler is restored when the last
+    // scope of the process exits, so input loops of several views can run on different threads.
+    // The handler is installed with SA_RESTART, so only waitKey_() is interrupted when the terminal is resized,
+    // not the reads done by the option callbacks.
+    class ResizeSignalGuard
+    {
+    public:
+        explicit ResizeSignalGuard(bool enable) : enabled_(enable), wakePipe_(-1), previousWakeFd_(resizeWakeFd_())
+        {
+        #ifndef _WIN32
+            if (!enabled_)
+                return;
+
+            ResizeSignalState& state = resizeSignalState_();
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            for (int i = 0; i < maxResizeWakeups && wakePipe_ == -1; ++i)
             {
-                std::string tmp = std::string((width - str.size()) / 2, ' ') + str;
-                tmp += std::string(width - tmp.size(), ' ');
-                return tmp;
+                if (state.isWakePipeActive[i])
+                    continue;
+
+                if (!state.isWakePipeCreated[i])
+                {
+                    if (::pipe(state.wakePipes[i]) != 0)
+                        break;
+
+                    for (int fd : state.wakePipes[i])
+                    {
+                        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    }
+
+                    state.isWakePipeCreated[i] = true;
+                }
+
+                // Discard the wake-ups of the previous input loop.
+                char buffer[64];
+                while (::read(state.wakePipes[i][0], buffer, sizeof(buffer)) > 0) {}
+
+                state.isWakePipeActive[i] = true;
+                wakePipe_ = i;
+                resizeWakeFd_() = state.wakePipes[i][0];
             }
-            default:
-                return str;
+
+            if (state.installCount++ != 0)
+                return;
+
+            struct sigaction action;
+            action.sa_handler = onResizeSignal_;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            ::sigaction(SIGWINCH, &action, &state.previous);
+        #endif // !_WIN32
+        }
+
+        ~ResizeSignalGuard()
+        {
+        #ifndef _WIN32
+            if (!enabled_)
+                return;
+
+            ResizeSignalState& state = resizeSignalState_();
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            if (--state.installCount == 0)
+                ::sigaction(SIGWINCH, &state.previous, nullptr);
+
+            if (wakePipe_ != -1)
+                state.isWakePipeActive[wakePipe_] = false;
+
+            resizeWakeFd_() = previousWakeFd_;
+        #endif // !_WIN32
+        }
+
+        ResizeSignalGuard(const ResizeSignalGuard& other) = delete;
+
+        ResizeSignalGuard& operator=(const ResizeSignalGuard& other) = delete;
+
+    private:
+        bool enabled_;
+        // The index of the wake-up pipe used, -1 if none.
+        int wakePipe_;
+        // The wake-up pipe of the enclosing input loop on this thread, e.g. of the parent menu of a submenu.
+        int previousWakeFd_;
+    };
+
+    // The column count and option text width actually used to display the menu.
+    struct GridLayout
+    {
+        size_t columnCount;
+        size_t optionTextWidth;
+    };
+
+    // Get the layout of the menu, fitted into the terminal width if auto reflow is enabled.
+    GridLayout gridLayout_(const Snapshot& s) const
+    {
+        GridLayout layout = { maxCol_(s), s.optionTextWidth };
+
+        // The auto-adjusted width only reserves space for the index, widen it for the selection marker.
+        if (s.enableAutoAdjustOptionTextWidth && s.enableMultiSelect && layout.optionTextWidth != 0)
+            layout.optionTextWidth += selectionMarkerWidth;
+
+        if (!s.enableAutoReflow || terminalWidth_ == 0 || layout.optionTextWidth == 0)
+            return layout;
+
+        // Keep the rows narrower than the terminal, otherwise the terminal wraps them.
+        // Drop columns first, then narrow the option text of the single column.
+        while (layout.columnCount > 1 && (layout.optionTextWidth + 1) * layout.columnCount + 1 >= terminalWidth_)
+            --layout.columnCount;
+
+        if (layout.optionTextWidth + 2 >= terminalWidth_)
+        {
+            layout.optionTextWidth = terminalWidth_ > minReflowOptionTextWidth + 3 ?
+                terminalWidth_ - 3 : minReflowOptionTextWidth;
         }
+
+        return layout;
     }
 
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
-    static bool isVaildColor_(int r, int g, int b)
+    // Start prefetching the highlighted option once it has been highlighted for the prefetch delay.
+    // Return the milliseconds to wait for a key before checking again, -1 if there is nothing to prefetch.
+    int prefetchIfDwelled_()
     {
-        return (r >= 0 && r <= 255) && (g >= 0 && g <= 255) && (b >= 0 && b <= 255);
+        SnapshotPtr s = snapshot_();
+        if (selectedOption_ >= s->options.size() || s->maxPrefetchCount == 0)
+            return -1;
+
+        OptionPtr option = s->options[selectedOption_];
+        if (!option->prefetchFunc || prefetcher_.contains(option))
+            return -1;
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - highlightTime_).count();
+        if (elapsed < s->prefetchDelay)
+            return static_cast<int>(s->prefetchDelay - elapsed);
+
+        // Check again later if the limit is reached, or a cancelled prefetch of the same work has not returned yet.
+        if (prefetcher_.runningCount() >= s->maxPrefetchCount || prefetcher_.isBusy(*option))
+            return prefetchRetryInterval;
+
+        prefetcher_.start(option);
+        return -1;
     }
-#else
-    static bool isValidColor(int color)
+
+    // Reflow and repaint the menu if the terminal has been resized.
+    // The repaint is deferred until the resize burst settles, so the menu is repainted only once.
+    void reflowIfResized_()
     {
-        return color >= 0 && color <= 255;
+        if (!snapshot_()->enableAutoReflow)
+            return;
+
+    #ifndef _WIN32
+        if (resizeCount_() == handledResizeCount_)
+            return;
+
+        std::sig_atomic_t count;
+        do
+        {
+            count = resizeCount_();
+            std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(resizeSettleTime)));
+        } while (count != resizeCount_());
+
+        handledResizeCount_ = count;
+    #endif // !_WIN32
+
+        size_t width = queryTerminalWidth_();
+        if (width == terminalWidth_)
+            return;
+
+        terminalWidth_ = width;
+
+        // Clear the rows wrapped by the terminal.
+        std::cout << "\x1b[2J";
+        update_();
     }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
 
-    // Reset all console attributes.
-    static void resetConsoleAttribute_() { std::cout << "\x1b[0m"; }
+    // A key sequence bound to an action.
+    struct KeyBinding
+    {
+        int keys[maxDefaultKeySequenceLength];
+        size_t length;
+        int action;
+    };
 
-    // Set the console background color for text.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
-    static void setConsoleBackgroundColor_(int r, int g, int b)
+    // The default key bindings as constant data, terminated by an empty sequence.
+    static const KeyBinding* defaultKeyBindings_()
     {
-        if (isVaildColor_(r, g, b))
-            std::cout << "\x1b[48;2;" << r << ";" << g << ";" << b << "m";
+        static constexpr KeyBinding bindings[] =
+        {
+        #ifdef _WIN32
+            { { 0x0D }, 1, KEY_ACTION_CONFIRM },        // Enter key
+        #else
+            { { 0x0A }, 1, KEY_ACTION_CONFIRM },        // Enter key
+        #endif // _WIN32
+            { { 0x1B }, 1, KEY_ACTION_EXIT },           // Escape key
+            { { 'a' }, 1, KEY_ACTION_LEFT },
+            { { 'w' }, 1, KEY_ACTION_UP },
+            { { 'd' }, 1, KEY_ACTION_RIGHT },
+            { { 's' }, 1, KEY_ACTION_DOWN },
+            { { ' ' }, 1, KEY_ACTION_TOGGLE_SELECT },
+            { { 'v' }, 1, KEY_ACTION_SELECT_RANGE },
+            { { 0x01 }, 1, KEY_ACTION_SELECT_ALL },     // Ctrl+A
+        #ifdef _WIN32
+            // The extended keys are prefixed by 0x00 or 0xE0.
+            { { 0x00, 0x4B }, 2, KEY_ACTION_LEFT },
+            { { 0x00, 0x48 }, 2, KEY_ACTION_UP },
+            { { 0x00, 0x4D }, 2, KEY_ACTION_RIGHT },
+            { { 0x00, 0x50 }, 2, KEY_ACTION_DOWN },
+            { { 0x00, 0x49 }, 2, KEY_ACTION_PAGE_UP },
+            { { 0x00, 0x51 }, 2, KEY_ACTION_PAGE_DOWN },
+            { { 0x00, 0x47 }, 2, KEY_ACTION_HOME },
+            { { 0x00, 0x4F }, 2, KEY_ACTION_END },
+            { { 0xE0, 0x4B }, 2, KEY_ACTION_LEFT },
+            { { 0xE0, 0x48 }, 2, KEY_ACTION_UP },
+            { { 0xE0, 0x4D }, 2, KEY_ACTION_RIGHT },
+            { { 0xE0, 0x50 }, 2, KEY_ACTION_DOWN },
+            { { 0xE0, 0x49 }, 2, KEY_ACTION_PAGE_UP },
+            { { 0xE0, 0x51 }, 2, KEY_ACTION_PAGE_DOWN },
+            { { 0xE0, 0x47 }, 2, KEY_ACTION_HOME },
+            { { 0xE0, 0x4F }, 2, KEY_ACTION_END },
+        #else
+            // The escape sequences of the normal and the application cursor key modes.
+            { { 0x1B, '[', 'D' }, 3, KEY_ACTION_LEFT },
+            { { 0x1B, '[', 'A' }, 3, KEY_ACTION_UP },
+            { { 0x1B, '[', 'C' }, 3, KEY_ACTION_RIGHT },
+            { { 0x1B, '[', 'B' }, 3, KEY_ACTION_DOWN },
+            { { 0x1B, '[', 'H' }, 3, KEY_ACTION_HOME },
+            { { 0x1B, '[', 'F' }, 3, KEY_ACTION_END },
+            { { 0x1B, 'O', 'D' }, 3, KEY_ACTION_LEFT },
+            { { 0x1B, 'O', 'A' }, 3, KEY_ACTION_UP },
+            { { 0x1B, 'O', 'C' }, 3, KEY_ACTION_RIGHT },
+            { { 0x1B, 'O', 'B' }, 3, KEY_ACTION_DOWN },
+            { { 0x1B, 'O', 'H' }, 3, KEY_ACTION_HOME },
+            { { 0x1B, 'O', 'F' }, 3, KEY_ACTION_END },
+            { { 0x1B, '[', '5', '~' }, 4, KEY_ACTION_PAGE_UP },
+            { { 0x1B, '[', '6', '~' }, 4, KEY_ACTION_PAGE_DOWN },
+            { { 0x1B, '[', '1', '~' }, 4, KEY_ACTION_HOME },
+            { { 0x1B, '[', '4', '~' }, 4, KEY_ACTION_END },
+        #endif // _WIN32
+            { { 0 }, 0, KEY_ACTION_NONE }
+        };
+
+        return bindings;
     }
-#else
-    static void setConsoleBackgroundColor_(Rgb color)
+
+    // The default key bindings, shared by all menus until modified.
+    static std::shared_ptr<const Keymap> defaultKeymap_()
+    {
+        static const std::shared_ptr<const Keymap> keymap = []()
+        {
+            std::shared_ptr<Keymap> keymap = std::make_shared<Keymap>();
+            for (const KeyBinding* binding = defaultKeyBindings_(); binding->length != 0; ++binding)
+                keymap->bind(std::vector<int>(binding->keys, binding->keys + binding->length), binding->action);
+
+            return keymap;
+        }();
+
+        return keymap;
+    }
+
+    // Get the current snapshot of the menu definition.
+    // Readers never modify the returned snapshot, so it can be used without any locking once loaded.
+    // The load itself may take the internal lock of std::atomic_load(), see Model.
+    // Inside edit(), the unpublished draft is returned instead.
+    SnapshotPtr snapshot_() const { return draft_ ? SnapshotPtr(draft_) : std::atomic_load(&model_->current); }
+
+    // Publish a new snapshot made by applying the modifier to a copy of the current snapshot.
+    // The modifier may be applied more than once if another writer publishes at the same time.
+    // Inside edit(), the modifier is applied to the draft in place and nothing is published.
+    template <typename Modifier>
+    void modify_(Modifier modifier)
     {
-        if (color != COLOR_NONE && isValidColor(color))
-            std::cout << "\x1b[48;5;" << color << "m";
+        if (draft_)
+        {
+            // The draft may be held by a reader, e.g. triggerOption() while a callback edits the menu.
+            if (draft_.use_count() != 1)
+                draft_ = std::make_shared<Snapshot>(*draft_);
+
+            modifier(*draft_);
+            return;
+        }
+
+        SnapshotPtr current = std::atomic_load(&model_->current);
+        while (true)
+        {
+            std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>(*current);
+            modifier(*next);
+
+            SnapshotPtr published = next;
+            if (std::atomic_compare_exchange_weak(&model_->current, &current, published))
+                return;
+        }
     }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
 
-    // Set the console foreground color for text.
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
-    static void setConsoleForegroundColor_(int r, int g, int b)
+    // Replace the specified option with a modified copy, other options are left shared.
+    template <typename Modifier>
+    void modifyOption_(size_t index, Modifier modifier)
     {
-        if (isVaildColor_(r, g, b))
-            std::cout << "\x1b[38;2;" << r << ";" << g << ";" << b << "m";
+        modify_([index, &modifier](Snapshot& s)
+        {
+            std::shared_ptr<Option> option = std::make_shared<Option>(*s.options.at(index));
+            modifier(*option);
+            s.options[index] = option;
+        });
     }
-#else
-    static void setConsoleForegroundColor_(Rgb color)
+
+    // Insert the option at the specified position, SIZE_MAX means the end of the menu.
+    void insertOption_(size_t index, const Option& option)
     {
-        if (color != COLOR_NONE && isValidColor(color))
-            std::cout << "\x1b[38;5;" << color << "m";
+        OptionPtr newOption = std::make_shared<Option>(option);
+        modify_([index, &newOption](Snapshot& s)
+        {
+            if (index == SIZE_MAX)
+                s.options.push_back(newOption);
+            else
+                s.options.insert(s.options.begin() + index, newOption);
+            ++s.optionListVersion;
+
+            if (s.enableAutoAdjustOptionTextWidth && newOption->text.size() + reserveSpace > s.optionTextWidth)
+                s.optionTextWidth = newOption->text.size() + reserveSpace;
+        });
     }
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
 
-    // Output text with specified colors.
-    static void outputText_(const std::string& text, const Rgb& foregroundColor, const Rgb& backgroundColor)
+    // Publish a new snapshot with a modified copy of the key bindings.
+    template <typename Modifier>
+    void modifyKeymap_(Modifier modifier)
     {
-    #ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
-        setConsoleForegroundColor_(foregroundColor[0], foregroundColor[1], foregroundColor[2]);
-        setConsoleBackgroundColor_(backgroundColor[0], backgroundColor[1], backgroundColor[2]);
-    #else
-        setConsoleForegroundColor_(foregroundColor);
-        setConsoleBackgroundColor_(backgroundColor);
-    #endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
+        modify_([&modifier](Snapshot& s)
+        {
+            std::shared_ptr<Keymap> keymap = std::make_shared<Keymap>(*s.keymap);
+            modifier(*keymap);
+            s.keymap = keymap;
+        });
+    }
+
+    bool isSelectionCurrent_(const Snapshot& s) const { return selectionVersion_ == s.optionListVersion; }
+
+    // Get the selection, cleared first if options have been inserted or removed since it was made,
+    // as its indices no longer refer to the same options.
+    IndexSet& currentSelection_(const Snapshot& s)
+    {
+        if (!isSelectionCurrent_(s))
+        {
+            selection_.clear();
+            selectionAnchor_ = 0;
+            selectionVersion_ = s.optionListVersion;
+        }
+
+        return selection_;
+    }
+
+    int addKeyAction_(const CallbackFunc& callback)
+    {
+        int action = KEY_ACTION_NONE;
+        modify_([&callback, &action](Snapshot& s)
+        {
+            action = KEY_ACTION_USER + static_cast<int>(s.keyActions.size());
+            s.keyActions.push_back(callback);
+        });
 
-        std::cout << text;
+        return action;
+    }
 
-        resetConsoleAttribute_();
+    template <typename Color>
+    void setColor_(Color Snapshot::* member, const Color& color)
+    {
+        modify_([member, &color](Snapshot& s) { s.*member = color; });
     }
 
-    size_t maxCol_() const { return maxColumn_ < getOptionCount() ? maxColumn_ : getOptionCount(); }
+    // Get the color sequences of the snapshot colors, rebuilt only if the colors or the color depth change.
+    const ColorSequences& cachedColorSequences_(const Snapshot& s)
+    {
+        std::array<int, 5> key = {{ s.foregroundColor, s.backgroundColor,
+            s.highlightForegroundColor, s.highlightBackgroundColor, colorDepth_ }};
+
+        if (key != colorSequencesKey_)
+        {
+            colorSequences_ = makeColorSequences_(s, colorDepth_);
+            colorSequencesKey_ = key;
+        }
+
+        return colorSequences_;
+    }
 
     // Update the console display.
     void update_()
     {
+        SnapshotPtr snapshot = snapshot_();
+        const Snapshot& s = *snapshot;
+        const std::vector<OptionPtr>& options = s.options;
+        GridLayout layout = gridLayout_(s);
+        size_t maxCol = layout.columnCount;
+        size_t optionTextWidth = layout.optionTextWidth;
+        const ColorSequences& colorSequences = cachedColorSequences_(s);
+
         // Clear the console and move the cursor to the top-left corner.
         std::cout << "\x1b[3J\x1b[H";
 
         // Output the top text if not empty.
-        if (!topText_.empty())
-            std::cout << topText_ << '\n' << std::endl;
+        if (!s.topText.empty())
+            std::cout << s.topText << '\n' << std::endl;
 
         // Calculate row width based on max columns and option text width.
         // Includes column separators.
-        size_t rowWidth = options_.empty() ? 0 : (optionTextWidth_ + 1) * maxCol_() + 1;
+        size_t rowWidth = options.empty() ? 0 : (optionTextWidth + 1) * maxCol + 1;
 
         // Output the top row separator if enabled.
-        if (rowSeparator_ != '\0' && optionTextWidth_ != 0)
-            std::cout << std::string(rowWidth, rowSeparator_) << std::endl;
+        if (s.rowSeparator != '\0' && optionTextWidth != 0)
+            std::cout << std::string(rowWidth, s.rowSeparator) << std::endl;
 
-        for (size_t i = 0; i < options_.size(); ++i)
+        for (size_t i = 0; i < options.size(); ++i)
         {
             std::string text;
 
+            // Add selection marker in multi-select mode.
+            if (s.enableMultiSelect)
+                text += currentSelection_(s).contains(i) ? "[*] " : "[ ] ";
+
             // Add index prefix if enabled.
-            if (enableShowIndex_)
+            if (s.enableShowIndex)
                 text += "[" + std::to_string(i) + "] ";
 
             // Append the option text.
-            text += options_[i].text;
+            text += options[i]->text;
 
-            // Justify text if optionTextWidth_ is set.
-            if (optionTextWidth_ != 0)
-                 text = justifyString_(text, optionTextWidth_, optionTextAlignment_);
+            // Justify text if optionTextWidth is set.
+            if (optionTextWidth != 0)
+                 text = justifyString_(text, optionTextWidth, s.optionTextAlignment);
 
-            std::cout << columnSeparator_;
+            std::cout << s.columnSeparator;
 
             // Output option text with appropriate colors.
-            if (i == selectedOption_)
-                outputText_(text, highlightForegroundColor_, highlightBackgroundColor_);
-            else
-                outputText_(text, foregroundColor_, backgroundColor_);
+            outputText_(text.data(), text.size(),
+                i == selectedOption_ ? colorSequences.highlight.c_str() : colorSequences.normal.c_str());
 
-            size_t posInRow = i % maxCol_();
-            bool isLastOneInRow = posInRow == maxCol_() - 1 || i == options_.size() - 1;
+            size_t posInRow = i % maxCol;
+            bool isLastOneInRow = posInRow == maxCol - 1 || i == options.size() - 1;
             // Handle end-of-row formatting.
             if (isLastOneInRow)
             {
                 // Output the final column separator.
-                std::cout << columnSeparator_;
+                std::cout << s.columnSeparator;
 
-                if (rowSeparator_ == '\0' || optionTextWidth_ == 0)
+                if (s.rowSeparator == '\0' || optionTextWidth == 0)
                 {
                     std::cout << std::endl;
                 }
                 else
                 {
                     // Fill missing columns in incomplete rows.
-                    if (posInRow != maxCol_() - 1)
+                    if (posInRow != maxCol - 1)
                     {
-                        size_t supplementWidth = (maxCol_() - posInRow - 1) * (optionTextWidth_ + 1);
+                        size_t supplementWidth = (maxCol - posInRow - 1) * (optionTextWidth + 1);
                         std::string supplement(supplementWidth, ' ');
 
-                        size_t curpos = optionTextWidth_;
-                        for (size_t i = 0; i < maxCol_() - posInRow - 1; ++i)
+                        size_t curpos = optionTextWidth;
+                        for (size_t i = 0; i < maxCol - posInRow - 1; ++i)
                         {
-                            supplement[curpos] = columnSeparator_;
-                            curpos += optionTextWidth_ + 1;
+                            supplement[curpos] = s.columnSeparator;
+                            curpos += optionTextWidth + 1;
                         }
 
                         std::cout << supplement;
@@ -664,15 +3095,15 @@ private:
                     std::cout << std::endl;
 
                     // Generate row separator with column separator markers.
-                    std::string separator(rowWidth, rowSeparator_);
+                    std::string separator(rowWidth, s.rowSeparator);
 
-                    if (i != options_.size() - 1)
+                    if (i != options.size() - 1)
                     {
                         size_t curpos = 0;
-                        for (size_t i = 0; i < maxCol_() + 1; ++i)
+                        for (size_t i = 0; i < maxCol + 1; ++i)
                         {
-                            separator[curpos] = columnSeparator_;
-                            curpos += optionTextWidth_ + 1;
+                            separator[curpos] = s.columnSeparator;
+                            curpos += optionTextWidth + 1;
                         }
                     }
 
@@ -682,61 +3113,65 @@ private:
         }
 
         // Output the bottom text if not empty.
-        if (!bottomText_.empty())
-            std::cout << '\n' << bottomText_ << std::endl;
+        if (!s.bottomText.empty())
+            std::cout << '\n' << s.bottomText << std::endl;
 
         std::cout << std::endl << std::flush;
     }
 
-    // Reserve space to prevent index text from being truncated during auto-width adjustment.
-    static const size_t reserveSpace = 8;
-
-    // Whether to show option indices.
-    bool enableShowIndex_                       = false;
-    // Whether to auto-adjust option text width based on longest option.
-    bool enableAutoAdjustOptionTextWidth_       = true;
-    // Column separator character. Default is '|'.
-    char columnSeparator_                       = '|';
-    // Row separator character. Default is '-'.
-    // Use '\0' to disable.
-    char rowSeparator_                          = '-';
-    // Text alignment for option display. Default is 0 (left-aligned).
-    // 0: left-justified, 1: right-justified, 2: center-justified.
-    int optionTextAlignment_                    = 0;
-    // Key to confirm selection.
-#ifdef _WIN32
-    int confirmKey_                             = 0x0D;  // Enter key
-#else
-    int confirmKey_                             = 0x0A;  // Enter key
-#endif // _WIN32
-    // Key to exit menu.
-    int exitKey_                                = 0x1B;  // Escape key
-    // Directional control keys: Left, Up, Right, Down.
-    std::array<int, 4> directionalControlKey_   = { 'a', 'w', 'd', 's' };
-    // Maximum number of columns for layout.
-    // Default is 1. Value 0 is treated as 1.
-    size_t maxColumn_                           = 1;
-    // Fixed width for option text display. Default is 0 (auto-width).
-    // 0 disables text justification and row separators.
-    size_t optionTextWidth_                     = 0;
+    // The menu definition, shared with the other views of the menu.
+    std::shared_ptr<Model> model_;
+    // The unpublished menu definition inside edit(), null otherwise.
+    std::shared_ptr<Snapshot> draft_;
     // Currently selected option index.
     size_t selectedOption_                      = 0;
-#ifdef COMMAND_LINE_MENU_USE_24BIT_COLOR
-    Rgb backgroundColor_                        = { -1, -1, -1 };
-    Rgb foregroundColor_                        = { -1, -1, -1 };
-    Rgb highlightBackgroundColor_               = { -1, -1, -1 };
-    Rgb highlightForegroundColor_               = { 0, 255, 0 };
-#else
-    Rgb backgroundColor_                        = COLOR_NONE;
-    Rgb foregroundColor_                        = COLOR_NONE;
-    Rgb highlightBackgroundColor_               = COLOR_NONE;
-    Rgb highlightForegroundColor_               = COLOR_GREEN;
-#endif // COMMAND_LINE_MENU_USE_24BIT_COLOR
-    std::string topText_;
-    std::string bottomText_;
-    std::vector<Option> options_;
+    // Terminal width used for reflow, 0 if unknown.
+    size_t terminalWidth_                       = 0;
+    // The resize count at the last reflow.
+    std::sig_atomic_t handledResizeCount_       = 0;
+    // The digits typed to jump to an option.
+    IndexTyping indexTyping_;
+    // Selected options of multi-select mode.
+    IndexSet selection_;
+    // The option list version the selection refers to.
+    std::uint64_t selectionVersion_             = 0;
+    // The last toggled option, the start of a range selection.
+    size_t selectionAnchor_                     = 0;
+    // When the highlighted option was highlighted.
+    std::chrono::steady_clock::time_point highlightTime_;
+    // Prefetches of the highlighted options.
+    Prefetcher prefetcher_;
+    // Color depth of the terminal.
+    ColorDepth colorDepth_                      = defaultColorDepth_();
+    // The colors and the color depth of the cached color sequences.
+    std::array<int, 5> colorSequencesKey_       = {{ -1, -1, -1, -1, -1 }};
+    ColorSequences colorSequences_;
     // Flag to control input loop termination.
     std::atomic<bool> shouldEndReceiveInput_;
 };
 
+template <>
+struct CommandLineMenu::MakeIndexSequenceImpl_<0> { using type = IndexSequence_<>; };
+
+template <>
+struct CommandLineMenu::MakeIndexSequenceImpl_<1> { using type = IndexSequence_<0>; };
+
+template <typename Generator, size_t... I>
+constexpr char CommandLineMenu::ConstantString_<Generator, CommandLineMenu::IndexSequence_<I...>>::value[];
+
+template <typename Generator, size_t... I>
+constexpr size_t CommandLineMenu::ConstantSizes_<Generator, CommandLineMenu::IndexSequence_<I...>>::value[];
+
+template <size_t N, const CommandLineMenu::StaticOption (&Options)[N], typename Layout>
+constexpr size_t CommandLineMenu::StaticMenu<N, Options, Layout>::optionCount;
+
+template <size_t N, const CommandLineMenu::StaticOption (&Options)[N], typename Layout>
+constexpr size_t CommandLineMenu::StaticMenu<N, Options, Layout>::columnCount;
+
+template <size_t N, const CommandLineMenu::StaticOption (&Options)[N], typename Layout>
+constexpr size_t CommandLineMenu::StaticMenu<N, Options, Layout>::optionTextWidth;
+
+template <size_t N, const CommandLineMenu::StaticOption (&Options)[N], typename Layout>
+constexpr size_t CommandLineMenu::StaticMenu<N, Options, Layout>::rowWidth;
+
 #endif // !COMMAND_LINE_MENU_HPP